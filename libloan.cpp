@@ -0,0 +1,1473 @@
+/*
+   libloan
+   Steve Connet
+
+   The loan math behind libloan.h. See there for how to build it.
+*/
+
+#include "libloan.h"
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <cstdint>
+#include <charconv>
+#include <utility>
+#include <algorithm>
+
+int loanVersion(void)
+{
+    return LOAN_VERSION;
+}
+
+// ----------------------------------------------------------------------------
+
+// the standard grid: yearly rates from 1/8% to 25% in 1/8% steps and
+// periods from 12 to 360 months in steps of 12
+#define TABLE_RATE_STEPS 8
+#define TABLE_RATES      200
+#define TABLE_TERMS      30
+
+// (1 + r)^-n by repeated squaring in long double, usable at compile time
+constexpr long double exactDiscount(long double monthlyInterestRate, int n)
+{
+    long double base = 1 + monthlyInterestRate;
+    long double power = 1;
+    while(n > 0)
+    {
+        if(n & 1)
+        {
+            power *= base;
+        }
+        base *= base;
+        n >>= 1;
+    }
+    return 1 / power;
+}
+
+// discount factors for every loan on the standard grid
+struct AnnuityTable
+{
+    double x[TABLE_RATES][TABLE_TERMS];
+};
+
+constexpr AnnuityTable makeAnnuityTable()
+{
+    AnnuityTable table = {};
+    for(int i = 0; i < TABLE_RATES; ++i)
+    {
+        for(int j = 0; j < TABLE_TERMS; ++j)
+        {
+            table.x[i][j] = (double)exactDiscount(
+                (i + 1) / (TABLE_RATE_STEPS * 1200.0L), 12 * (j + 1));
+        }
+    }
+    return table;
+}
+
+// worked out by the compiler and stored in the binary
+constexpr AnnuityTable annuityTable = makeAnnuityTable();
+
+// discount factor of a loan on the standard grid, false if it isn't on it
+static inline bool standardFactor(double yearlyInterestRate,
+                                  double numberPayments, double &x)
+{
+    // multiples of 1/8 and of 12 come through these exactly
+    double rate = yearlyInterestRate * TABLE_RATE_STEPS;
+    double term = numberPayments / 12.0;
+
+    if(!(rate >= 1 && rate <= TABLE_RATES && term >= 1 &&
+         term <= TABLE_TERMS))
+    {
+        return false;
+    }
+
+    int i = (int)rate;
+    int j = (int)term;
+    if(i != rate || j != term)
+    {
+        return false;
+    }
+
+    x = annuityTable.x[i - 1][j - 1];
+    return true;
+}
+
+// discount factor (1 + monthly rate)^-period
+static inline double discountFactor(double yearlyInterestRate,
+                                    double numberPayments)
+{
+    double x;
+    if(standardFactor(yearlyInterestRate, numberPayments, x))
+    {
+        return x;
+    }
+    return std::pow(1 + yearlyInterestRate / 1200.0, -numberPayments);
+}
+
+// walks the discount factor (1 + r)^-n across a sweep of periods
+// n = first, first + step, ... with one multiply per row instead of a pow().
+// every ANCHOR_INTERVAL rows the factor is recomputed exactly so rounding
+// error can't accumulate over long (e.g. month by month) sweeps.
+class TermSweep
+{
+public:
+    enum { ANCHOR_INTERVAL = 32 };
+
+    TermSweep(double yearlyInterestRate, double first, double step)
+        : rate(yearlyInterestRate), firstPeriod(first), periodStep(step),
+          rows(0)
+    {
+        stepFactor = discountFactor(rate, periodStep);
+        x = discountFactor(rate, firstPeriod);
+    }
+
+    double numberPayments() const { return firstPeriod + rows * periodStep; }
+    double factor() const { return x; }
+
+    void next()
+    {
+        double period = firstPeriod + ++rows * periodStep;
+        if(standardFactor(rate, period, x))
+        {
+            return;
+        }
+        else if(rows % ANCHOR_INTERVAL == 0)
+        {
+            x = std::pow(1 + rate / 1200.0, -period);
+        }
+        else
+        {
+            x *= stepFactor;
+        }
+    }
+
+private:
+    double rate;
+    double firstPeriod;
+    double periodStep;
+    double stepFactor;
+    double x;
+    long rows;
+};
+
+// on x86-64 gcc/clang build the array kernels below once per instruction set
+// and pick the widest one the cpu supports at load time. "default" is plain
+// x86-64, ie. SSE2.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+// log1pSeries() below is good to a few ulps (libloan_test checks 4) for
+// monthly rates up to SIMD_MAX_MONTHLY_RATE, and together the two limits
+// keep the exponent handed to simdExp() under 708. anything outside falls
+// back to pow().
+#define SIMD_MAX_MONTHLY_RATE 0.125
+#define SIMD_MAX_PERIOD       6000.0
+
+// exp(y) for |y| < 708 without calling libm or branching so the loop calling
+// it can be vectorized. y = k ln2 + t with |t| <= ln2/2, exp(t) by Taylor
+// series. the result is garbage for larger |y|.
+static inline double simdExp(double y)
+{
+    const double ROUND = 6755399441055744.0; // 1.5 * 2^52
+    const double LN2_HI = 6.93147180369123816490e-01;
+    const double LN2_LO = 1.90821492927058770002e-10;
+
+    // round y / ln2 to the nearest integer k, which lands in the low mantissa
+    // bits of kd
+    double kd = y * 1.44269504088896338700 + ROUND;
+    uint64_t kbits;
+    std::memcpy(&kbits, &kd, sizeof(kbits));
+    kd -= ROUND;
+
+    double t = (y - kd * LN2_HI) - kd * LN2_LO;
+    double p = 1.0 / 6227020800.0;
+    p = p * t + 1.0 / 479001600.0;
+    p = p * t + 1.0 / 39916800.0;
+    p = p * t + 1.0 / 3628800.0;
+    p = p * t + 1.0 / 362880.0;
+    p = p * t + 1.0 / 40320.0;
+    p = p * t + 1.0 / 5040.0;
+    p = p * t + 1.0 / 720.0;
+    p = p * t + 1.0 / 120.0;
+    p = p * t + 1.0 / 24.0;
+    p = p * t + 1.0 / 6.0;
+    p = p * t + 0.5;
+    p = p * t + 1.0;
+    p = p * t + 1.0;
+
+    // 2^k built straight into the exponent field
+    uint64_t sbits = (kbits + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &sbits, sizeof(scale));
+    return p * scale;
+}
+
+// log(y) for any normal y > 0 without calling libm or branching. y is split
+// into 2^k f with f in [sqrt(1/2), sqrt(2)) by moving its exponent, and
+// log f = 2 atanh(s) = 2 (s + s^3/3 + ...), s = (f - 1)/(f + 1) <= 0.172.
+// only unsigned shifts and adds, which every vector unit has. the result
+// is garbage for other y.
+static inline double simdLog(double y)
+{
+    const uint64_t SQRT_HALF = 0x3fe6a09e667f3bcdULL;
+    const uint64_t BIAS = 1024ULL << 52;
+    const double TWO52 = 4503599627370496.0; // 2^52
+    const double LN2_HI = 6.93147180369123816490e-01;
+    const double LN2_LO = 1.90821492927058770002e-10;
+
+    // k + 1024, always positive, then f = y / 2^k
+    uint64_t bits;
+    std::memcpy(&bits, &y, sizeof(bits));
+    uint64_t biased = (bits - SQRT_HALF + BIAS) >> 52;
+    uint64_t fbits = bits + BIAS - (biased << 52);
+    double f;
+    std::memcpy(&f, &fbits, sizeof(f));
+
+    // k as a double: biased lands in the low mantissa bits of 2^52
+    uint64_t kbits = 0x4330000000000000ULL | biased;
+    double kd;
+    std::memcpy(&kd, &kbits, sizeof(kd));
+    kd -= TWO52 + 1024.0;
+
+    double s = (f - 1.0) / (f + 1.0);
+    double s2 = s * s;
+    double p = 1.0 / 23.0;
+    p = p * s2 + 1.0 / 21.0;
+    p = p * s2 + 1.0 / 19.0;
+    p = p * s2 + 1.0 / 17.0;
+    p = p * s2 + 1.0 / 15.0;
+    p = p * s2 + 1.0 / 13.0;
+    p = p * s2 + 1.0 / 11.0;
+    p = p * s2 + 1.0 / 9.0;
+    p = p * s2 + 1.0 / 7.0;
+    p = p * s2 + 1.0 / 5.0;
+    p = p * s2 + 1.0 / 3.0;
+    p = p * s2 + 1.0;
+
+    return kd * LN2_HI + (2.0 * s * p + kd * LN2_LO);
+}
+
+// log1p(r) for 0 <= r <= SIMD_MAX_MONTHLY_RATE without calling libm or
+// branching, as 2 atanh(s) = 2 (s + s^3/3 + s^5/5 + ...), s = r/(2 + r).
+// the kernels below all go through this one series.
+static inline double log1pSeries(double r)
+{
+    double s = r / (2.0 + r);
+    double s2 = s * s;
+    double p = 1.0 / 17.0;
+    p = p * s2 + 1.0 / 15.0;
+    p = p * s2 + 1.0 / 13.0;
+    p = p * s2 + 1.0 / 11.0;
+    p = p * s2 + 1.0 / 9.0;
+    p = p * s2 + 1.0 / 7.0;
+    p = p * s2 + 1.0 / 5.0;
+    p = p * s2 + 1.0 / 3.0;
+    p = p * s2 + 1.0;
+    return 2.0 * s * p;
+}
+
+// discount factors x[i] = (1 + rates[i] / 1200)^-periods[i] for a whole
+// array of loans at once. written as a flat loop over simdExp() and
+// log1pSeries() so the compiler turns it into 2/4/8 wide vector
+// code; the odd lane the series can't handle is redone with pow().
+SIMD_CLONES
+static void discountFactors(const double *rates, const double *periods,
+                            double *x, int count)
+{
+    for(int i = 0; i < count; ++i)
+    {
+        x[i] = simdExp(-periods[i] * log1pSeries(rates[i] / 1200.0));
+    }
+
+    for(int i = 0; i < count; ++i)
+    {
+        double r = rates[i] / 1200.0;
+        if(!(r >= 0 && r <= SIMD_MAX_MONTHLY_RATE) ||
+           !(periods[i] >= -SIMD_MAX_PERIOD && periods[i] <= SIMD_MAX_PERIOD))
+        {
+            x[i] = discountFactor(rates[i], periods[i]);
+        }
+    }
+}
+
+// discountFactors() that takes loans on the standard grid straight from
+// annuityTable and computes only the rest
+void loanDiscountFactors(const double *rates, const double *periods,
+                         double *x, long count)
+{
+    const int CHUNK = 256;
+    double missRates[CHUNK];
+    double missPeriods[CHUNK];
+    double missFactors[CHUNK];
+    int missIndex[CHUNK];
+
+    for(long begin = 0; begin < count; begin += CHUNK)
+    {
+        long end = count - begin < CHUNK ? count : begin + CHUNK;
+        int missCount = 0;
+
+        for(long i = begin; i < end; ++i)
+        {
+            if(!standardFactor(rates[i], periods[i], x[i]))
+            {
+                missRates[missCount] = rates[i];
+                missPeriods[missCount] = periods[i];
+                missIndex[missCount] = i;
+                ++missCount;
+            }
+        }
+
+        if(missCount > 0)
+        {
+            discountFactors(missRates, missPeriods, missFactors, missCount);
+            for(int j = 0; j < missCount; ++j)
+            {
+                x[missIndex[j]] = missFactors[j];
+            }
+        }
+    }
+}
+
+// x where pick and y where not, by masking their bits. with trapping math
+// gcc won't turn a ?: between doubles into a vector blend, but it will
+// this.
+static inline double blend(bool pick, double x, double y)
+{
+    uint64_t mask = 0 - (uint64_t)pick;
+    uint64_t xbits;
+    uint64_t ybits;
+    std::memcpy(&xbits, &x, sizeof(xbits));
+    std::memcpy(&ybits, &y, sizeof(ybits));
+    uint64_t bits = (xbits & mask) | (ybits & ~mask);
+    double z;
+    std::memcpy(&z, &bits, sizeof(z));
+    return z;
+}
+
+// most iterations loanSolveRates() will take; bisection alone gets to the last
+// bit well before this
+#define RATE_ITERATIONS 200
+
+// yearly rates[i] that pay off principles[i] with periods[i] payments of
+// payments[i], for a whole array of loans. safeguarded Newton on the
+// annuity factor a(r) = (1 - (1 + r)^-n) / r = principle / payment:
+// every lane keeps a bracket around its root and bisects whenever Newton
+// would leave it. all lanes step together through discountFactors(), and
+// a lane that has converged is masked out of further updates by blends
+// on done[i], 1 once it has and 0 until then, rather than by branching,
+// so the update vectorizes like the kernels above. loans that can't be
+// paid off at any positive rate come back as NaN.
+SIMD_CLONES
+void loanSolveRates(const double *principles, const double *payments,
+                    const double *periods, double *rates, long count)
+{
+    const int CHUNK = 256;
+    double lo[CHUNK];
+    double hi[CHUNK];
+    double r[CHUNK];
+    double yearly[CHUNK];
+    double x[CHUNK];
+    double done[CHUNK];
+
+    for(long begin = 0; begin < count; begin += CHUNK)
+    {
+        int n = count - begin < CHUNK ? (int)(count - begin) : CHUNK;
+        const double *p = principles + begin;
+        const double *m = payments + begin;
+        const double *t = periods + begin;
+        double active = 0;
+
+        for(int i = 0; i < n; ++i)
+        {
+            // the payment has to cover the interest, so r < m / p. start
+            // from the usual 2 (nm - p) / (p (n + 1)) approximation
+            lo[i] = 0;
+            hi[i] = m[i] / p[i];
+            double guess = 2.0 * (t[i] * m[i] - p[i]) / (p[i] * (t[i] + 1));
+            bool inside = (guess > lo[i]) & (guess < hi[i]);
+            bool solvable = (p[i] > 0) & (m[i] > 0) & (t[i] > 0) &
+                            (t[i] * m[i] > p[i]);
+
+            r[i] = blend(solvable, blend(inside, guess, 0.5 * hi[i]), NAN);
+            done[i] = blend(solvable, 0.0, 1.0);
+            active += 1.0 - done[i];
+        }
+
+        for(int iteration = 0; active > 0 && iteration < RATE_ITERATIONS;
+            ++iteration)
+        {
+            for(int i = 0; i < n; ++i)
+            {
+                yearly[i] = r[i] * 1200.0;
+            }
+            discountFactors(yearly, t, x, n);
+
+            active = 0;
+            for(int i = 0; i < n; ++i)
+            {
+                double a = (1 - x[i]) / r[i];
+                double da = (t[i] * x[i] / (1 + r[i]) - a) / r[i];
+
+                // a(r) falls as r rises, so a root above r means a > target
+                bool above = a * m[i] > p[i];
+                double newLo = blend(above, r[i], lo[i]);
+                double newHi = blend(above, hi[i], r[i]);
+
+                double newton = r[i] - (a - p[i] / m[i]) / da;
+                double bisect = 0.5 * (newLo + newHi);
+                bool inside = (newton > newLo) & (newton < newHi);
+                double next = blend(inside, newton, bisect);
+
+                bool converged = (std::fabs(next - r[i]) <= 1e-15 * r[i]) |
+                                 (newHi - newLo <= 1e-15 * newHi);
+
+                bool stopped = done[i] != 0;
+                lo[i] = blend(stopped, lo[i], newLo);
+                hi[i] = blend(stopped, hi[i], newHi);
+                r[i] = blend(stopped, r[i], next);
+                done[i] = blend(stopped | converged, 1.0, 0.0);
+                active += 1.0 - done[i];
+            }
+        }
+
+        for(int i = 0; i < n; ++i)
+        {
+            rates[begin + i] = r[i] * 1200.0;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+LoanResult loanSolvePayment(double principleAmount, double yearlyInterestRate,
+                            double numberPayments)
+{
+    return loanPaymentGivenFactor(principleAmount, yearlyInterestRate,
+                                  numberPayments,
+                                  discountFactor(yearlyInterestRate,
+                                                 numberPayments));
+}
+
+LoanResult loanSolvePrinciple(double monthlyPayment, double numberPayments,
+                              double yearlyInterestRate)
+{
+    return loanPrincipleGivenFactor(monthlyPayment, numberPayments,
+                                    yearlyInterestRate,
+                                    discountFactor(yearlyInterestRate,
+                                                   numberPayments));
+}
+
+LoanResult loanSolveRate(double principleAmount, double monthlyPayment,
+                         double numberPayments)
+{
+    LoanResult r;
+    r.principleAmount = principleAmount;
+    r.monthlyPayment = monthlyPayment;
+    r.numberPayments = numberPayments;
+    loanSolveRates(&principleAmount, &monthlyPayment, &numberPayments,
+                   &r.yearlyInterestRate, 1);
+    loanTotals(&r);
+    return r;
+}
+
+// the totals of a loan paid off in r.numberPayments, fractional: floor(n)
+// full payments and a smaller final one. growth is (1 + monthly
+// rate)^floor(n).
+static void termTotals(LoanResult &r, double growth)
+{
+    double monthlyInterestRate = r.yearlyInterestRate / 1200.0;
+    loanTotals(&r);
+
+    // balance left after the last full payment, paid off a month later.
+    // at no interest the payments simply add up.
+    double fullPayments = std::floor(r.numberPayments + 1e-9);
+    double repaid = monthlyInterestRate == 0 ?
+                    r.monthlyPayment * fullPayments :
+                    r.monthlyPayment * (growth - 1) / monthlyInterestRate;
+    double balance = r.principleAmount * growth - repaid;
+    double finalPayment = 0;
+    if(r.numberPayments - fullPayments > 1e-9)
+    {
+        finalPayment = balance * (1 + monthlyInterestRate);
+    }
+
+    r.totalPaid = r.monthlyPayment * fullPayments + finalPayment;
+    r.interestPaid = r.totalPaid - r.principleAmount;
+    r.interestPaidPercent = (r.interestPaid / r.principleAmount) * 100.0;
+}
+
+// closed form n = -log(1 - p r / m) / log(1 + r), which is p / m as r
+// goes to 0
+static double termPeriod(double principleAmount, double monthlyPayment,
+                         double monthlyInterestRate)
+{
+    if(monthlyInterestRate == 0)
+    {
+        return principleAmount / monthlyPayment;
+    }
+    return -std::log1p(-principleAmount * monthlyInterestRate /
+                       monthlyPayment) / std::log1p(monthlyInterestRate);
+}
+
+LoanResult loanSolveTerm(double principleAmount, double monthlyPayment,
+                         double yearlyInterestRate)
+{
+    LoanResult r;
+    double monthlyInterestRate = yearlyInterestRate / 1200.0;
+    double n = termPeriod(principleAmount, monthlyPayment,
+                          monthlyInterestRate);
+
+    r.principleAmount = principleAmount;
+    r.monthlyPayment = monthlyPayment;
+    r.numberPayments = n;
+    r.yearlyInterestRate = yearlyInterestRate;
+    termTotals(r, std::pow(1 + monthlyInterestRate, std::floor(n + 1e-9)));
+    return r;
+}
+
+// the closed form of loanSolveTerm() for a whole array of loans, through
+// simdLog() and log1pSeries() so it vectorizes. lanes outside the series'
+// range, 0% among them, are redone with termPeriod(), and loans whose
+// payment doesn't cover the interest get NaN either way.
+SIMD_CLONES
+static void termPeriods(const double *principles, const double *payments,
+                        const double *rates, double *periods, int count)
+{
+    for(int i = 0; i < count; ++i)
+    {
+        double r = rates[i] / 1200.0;
+        double left = 1.0 - principles[i] * r / payments[i];
+        periods[i] = -simdLog(left) / log1pSeries(r);
+    }
+
+    for(int i = 0; i < count; ++i)
+    {
+        double r = rates[i] / 1200.0;
+        double left = 1.0 - principles[i] * r / payments[i];
+        if(!(r > 0 && r <= SIMD_MAX_MONTHLY_RATE) ||
+           !(left >= DBL_MIN && left <= 1.0))
+        {
+            periods[i] = termPeriod(principles[i], payments[i], r);
+        }
+    }
+}
+
+void loanSolveTerms(const double *principles, const double *payments,
+                    const double *yearlyInterestRates, LoanResult *results,
+                    long count)
+{
+    const int CHUNK = 256;
+    double n[CHUNK];
+    double full[CHUNK];
+    double x[CHUNK];
+
+    for(long begin = 0; begin < count; begin += CHUNK)
+    {
+        int m = count - begin < CHUNK ? (int)(count - begin) : CHUNK;
+        termPeriods(principles + begin, payments + begin,
+                    yearlyInterestRates + begin, n, m);
+
+        // (1 + r)^floor(n) as one over the discount factor
+        for(int i = 0; i < m; ++i)
+        {
+            full[i] = std::floor(n[i] + 1e-9);
+        }
+        loanDiscountFactors(yearlyInterestRates + begin, full, x, m);
+
+        for(int i = 0; i < m; ++i)
+        {
+            LoanResult &r = results[begin + i];
+            r.principleAmount = principles[begin + i];
+            r.monthlyPayment = payments[begin + i];
+            r.numberPayments = n[i];
+            r.yearlyInterestRate = yearlyInterestRates[begin + i];
+            termTotals(r, 1.0 / x[i]);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+// a number carried along with its first and second derivatives with
+// respect to two inputs, the yearly rate (0) and the period (1), so running
+// a formula on Duals differentiates it exactly in the same pass. d[i] is
+// the derivative along input i, dd the second derivatives along rate and
+// rate, rate and period, and period and period.
+struct Dual
+{
+    double v;
+    double d[2];
+    double dd[3];
+
+    Dual(double value = 0) : v(value), d{0, 0}, dd{0, 0, 0} {}
+
+    // input which of the formula, with derivative 1 along itself
+    static Dual input(double value, int which)
+    {
+        Dual x(value);
+        x.d[which] = 1;
+        return x;
+    }
+
+    // f(x) given f(v), f'(v) and f''(v), by the chain rule
+    Dual apply(double f, double f1, double f2) const
+    {
+        Dual x(f);
+        x.d[0] = f1 * d[0];
+        x.d[1] = f1 * d[1];
+        x.dd[0] = f2 * d[0] * d[0] + f1 * dd[0];
+        x.dd[1] = f2 * d[0] * d[1] + f1 * dd[1];
+        x.dd[2] = f2 * d[1] * d[1] + f1 * dd[2];
+        return x;
+    }
+};
+
+static inline Dual operator+(const Dual &a, const Dual &b)
+{
+    Dual x(a.v + b.v);
+    for(int i = 0; i < 2; ++i)
+    {
+        x.d[i] = a.d[i] + b.d[i];
+    }
+    for(int i = 0; i < 3; ++i)
+    {
+        x.dd[i] = a.dd[i] + b.dd[i];
+    }
+    return x;
+}
+
+static inline Dual operator-(const Dual &a)
+{
+    return a.apply(-a.v, -1, 0);
+}
+
+static inline Dual operator-(const Dual &a, const Dual &b)
+{
+    return a + -b;
+}
+
+static inline Dual operator*(const Dual &a, const Dual &b)
+{
+    Dual x(a.v * b.v);
+    for(int i = 0; i < 2; ++i)
+    {
+        x.d[i] = a.d[i] * b.v + a.v * b.d[i];
+    }
+    x.dd[0] = a.dd[0] * b.v + 2 * a.d[0] * b.d[0] + a.v * b.dd[0];
+    x.dd[1] = a.dd[1] * b.v + a.d[0] * b.d[1] + a.d[1] * b.d[0] +
+              a.v * b.dd[1];
+    x.dd[2] = a.dd[2] * b.v + 2 * a.d[1] * b.d[1] + a.v * b.dd[2];
+    return x;
+}
+
+static inline Dual operator/(const Dual &a, const Dual &b)
+{
+    double inverse = 1 / b.v;
+    return a * b.apply(inverse, -inverse * inverse,
+                       2 * inverse * inverse * inverse);
+}
+
+static inline Dual log1p(const Dual &a)
+{
+    double inverse = 1 / (1 + a.v);
+    return a.apply(std::log1p(a.v), inverse, -inverse * inverse);
+}
+
+static LoanSensitivity sensitivity(const Dual &x)
+{
+    LoanSensitivity s;
+    s.dRate = x.d[0];
+    s.dTerm = x.d[1];
+    s.d2Rate = x.dd[0];
+    s.d2RateTerm = x.dd[1];
+    s.d2Term = x.dd[2];
+    return s;
+}
+
+// the derivatives of a loan solved for SolveFor given its discount factor
+// x = (1 + m)^-n. the factor is carried through its exponent -n log1p(m)
+// by the chain rule, but its value is the x the solve already has, so
+// only log1p() is worked out again.
+template<int SolveFor>
+static LoanSensitivity sensitivityGivenFactor(double amount,
+                                              double yearlyInterestRate,
+                                              double numberPayments,
+                                              double x)
+{
+    Dual monthlyInterestRate = Dual::input(yearlyInterestRate, 0) /
+                               Dual(1200.0);
+    Dual exponent = -Dual::input(numberPayments, 1) *
+                    log1p(monthlyInterestRate);
+    Dual factor = exponent.apply(x, x, x);
+
+    if constexpr(SolveFor == LOAN_SOLVE_PRINCIPLE)
+    {
+        return sensitivity(Dual(amount) * (Dual(1.0) - factor) /
+                           monthlyInterestRate);
+    }
+    else
+    {
+        return sensitivity(Dual(amount) * monthlyInterestRate /
+                           (Dual(1.0) - factor));
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+// one loan of a sweep solved for SolveFor given its discount factor, the
+// choice made at compile time
+template<int SolveFor>
+static inline LoanResult givenFactor(double amount, double yearlyInterestRate,
+                                     double numberPayments, double x)
+{
+    if constexpr(SolveFor == LOAN_SOLVE_PRINCIPLE)
+    {
+        return loanPrincipleGivenFactor(amount, numberPayments,
+                                        yearlyInterestRate, x);
+    }
+    else
+    {
+        return loanPaymentGivenFactor(amount, yearlyInterestRate,
+                                      numberPayments, x);
+    }
+}
+
+// the sweeps below fill sensitivities too when Sensitive, from the same
+// factor as each row
+template<int SolveFor, bool Sensitive>
+static void sweepTerms(double amount, double yearlyInterestRate, double first,
+                       double step, long begin, long end,
+                       LoanResult *results, LoanSensitivity *sensitivities)
+{
+    TermSweep sweep(yearlyInterestRate, first + begin * step, step);
+    for(long i = begin; i < end; ++i)
+    {
+        *results++ = givenFactor<SolveFor>(amount, yearlyInterestRate,
+                                           sweep.numberPayments(),
+                                           sweep.factor());
+        if constexpr(Sensitive)
+        {
+            *sensitivities++ = sensitivityGivenFactor<SolveFor>(
+                amount, yearlyInterestRate, sweep.numberPayments(),
+                sweep.factor());
+        }
+        sweep.next();
+    }
+}
+
+template<int SolveFor, bool Sensitive>
+static void sweepRates(double amount, double numberPayments, double first,
+                       double step, long begin, long end,
+                       LoanResult *results, LoanSensitivity *sensitivities)
+{
+    double r[256];
+    double periods[256];
+    double x[256];
+
+    while(begin < end)
+    {
+        int count = end - begin < 256 ? (int)(end - begin) : 256;
+        for(int i = 0; i < count; ++i)
+        {
+            r[i] = first + (begin + i) * step;
+            periods[i] = numberPayments;
+        }
+
+        loanDiscountFactors(r, periods, x, count);
+        for(int i = 0; i < count; ++i)
+        {
+            *results++ = givenFactor<SolveFor>(amount, r[i], numberPayments,
+                                               x[i]);
+            if constexpr(Sensitive)
+            {
+                *sensitivities++ = sensitivityGivenFactor<SolveFor>(
+                    amount, r[i], numberPayments, x[i]);
+            }
+        }
+        begin += count;
+    }
+}
+
+// the sweeps pick the loop for solveFor once, so no row tests it
+void loanSweepTerms(int solveFor, double amount, double yearlyInterestRate,
+                    double first, double step, long begin, long end,
+                    LoanResult *results)
+{
+    if(solveFor == LOAN_SOLVE_PRINCIPLE)
+    {
+        sweepTerms<LOAN_SOLVE_PRINCIPLE, false>(amount, yearlyInterestRate,
+                                                first, step, begin, end,
+                                                results, NULL);
+    }
+    else
+    {
+        sweepTerms<LOAN_SOLVE_PAYMENT, false>(amount, yearlyInterestRate,
+                                              first, step, begin, end,
+                                              results, NULL);
+    }
+}
+
+void loanSweepRates(int solveFor, double amount, double numberPayments,
+                    double first, double step, long begin, long end,
+                    LoanResult *results)
+{
+    if(solveFor == LOAN_SOLVE_PRINCIPLE)
+    {
+        sweepRates<LOAN_SOLVE_PRINCIPLE, false>(amount, numberPayments, first,
+                                                step, begin, end, results,
+                                                NULL);
+    }
+    else
+    {
+        sweepRates<LOAN_SOLVE_PAYMENT, false>(amount, numberPayments, first,
+                                              step, begin, end, results,
+                                              NULL);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+// loans loanCashFlows() works through together. their state is a few KB,
+// so it stays in L1 for every month of the block instead of the whole
+// book streaming through the cache once a month
+#define FLOW_BLOCK 256
+#define FLOW_LANES 8
+
+// one month of a block of loans, smm of each balance left after the
+// scheduled payment being prepaid. with trapping math gcc won't turn the
+// choices below into vector selects, so they are made by multiplying with
+// weights of exactly 0 or 1 instead, which gives the same answer for any
+// finite amounts. no payment takes more principle than the balance, so a
+// loan paying more than its level payment is simply paid off early and
+// adds nothing after that. the flows are summed into FLOW_LANES partial
+// sums so the adds vectorize too without being reordered, which keeps the
+// totals the same on every cpu. returns the balance left on the block.
+SIMD_CLONES
+static double flowMonth(double *__restrict balance, double *__restrict payment,
+                      const double *rate, const int64_t *last, int count,
+                      int64_t month, double smm, double *interest,
+                      double *principle, double *prepaid)
+{
+    double paid[FLOW_BLOCK];
+    double repaid[FLOW_BLOCK];
+    double prepay[FLOW_BLOCK];
+
+    for(int k = 0; k < count; ++k)
+    {
+        double active = month <= last[k];
+        double final = month == last[k];
+
+        // the last payment clears the balance, later ones are nothing
+        double owed = balance[k] * rate[k];
+        double scheduled = std::min(payment[k] - owed, balance[k]);
+        double off = scheduled * (1.0 - final) + balance[k] * final;
+
+        paid[k] = owed * active;
+        repaid[k] = off * active;
+        balance[k] -= repaid[k];
+
+        // what's left still amortizes over the same months, so the payment
+        // shrinks along with the balance
+        prepay[k] = balance[k] * smm;
+        balance[k] -= prepay[k];
+        payment[k] *= 1.0 - smm;
+    }
+
+    double interestSum[FLOW_LANES] = {};
+    double principleSum[FLOW_LANES] = {};
+    double prepaidSum[FLOW_LANES] = {};
+    double balanceSum[FLOW_LANES] = {};
+    for(int i = 0; i < count; i += FLOW_LANES)
+    {
+        for(int j = 0; j < FLOW_LANES; ++j)
+        {
+            interestSum[j] += paid[i + j];
+            principleSum[j] += repaid[i + j];
+            prepaidSum[j] += prepay[i + j];
+            balanceSum[j] += balance[i + j];
+        }
+    }
+
+    double left = 0;
+    for(int j = 0; j < FLOW_LANES; ++j)
+    {
+        *interest += interestSum[j];
+        *principle += principleSum[j];
+        *prepaid += prepaidSum[j];
+        left += balanceSum[j];
+    }
+    return left;
+}
+
+void loanCashFlows(const double *principles, const double *payments,
+                   const double *yearlyInterestRates, const double *periods,
+                   long count, double *interest, double *principle,
+                   long months)
+{
+    loanPrepaidCashFlows(principles, payments, yearlyInterestRates, periods,
+                         count, NULL, interest, principle, NULL, months);
+}
+
+double loanMonthlyPrepayment(double cpr)
+{
+    return 1.0 - std::pow(1.0 - cpr / 100.0, 1.0 / 12.0);
+}
+
+void loanPrepaidCashFlows(const double *principles, const double *payments,
+                          const double *yearlyInterestRates,
+                          const double *periods, long count,
+                          const double *smm, double *interest,
+                          double *principle, double *prepaid, long months)
+{
+    double balance[FLOW_BLOCK];
+    double rate[FLOW_BLOCK];
+    double payment[FLOW_BLOCK];
+    int64_t last[FLOW_BLOCK];
+
+    for(long begin = 0; begin < count; begin += FLOW_BLOCK)
+    {
+        int n = count - begin < FLOW_BLOCK ? (int)(count - begin) :
+                                             FLOW_BLOCK;
+        int64_t longest = -1;
+        for(int i = 0; i < n; ++i)
+        {
+            balance[i] = principles[begin + i];
+            rate[i] = yearlyInterestRates[begin + i] / 1200.0;
+            payment[i] = payments[begin + i];
+            last[i] = (int64_t)std::ceil(periods[begin + i] - 1e-9) - 1;
+            longest = last[i] > longest ? last[i] : longest;
+        }
+
+        // pad to whole vectors with loans that never pay
+        int padded = (n + FLOW_LANES - 1) / FLOW_LANES * FLOW_LANES;
+        for(int i = n; i < padded; ++i)
+        {
+            balance[i] = 0;
+            rate[i] = 0;
+            payment[i] = 0;
+            last[i] = -1;
+        }
+
+        // with no prepayments at all the balance and payment are only
+        // ever multiplied by exactly 1, so the flows come out the same as
+        // if they had never been looked at. the block is done once every
+        // loan in it is paid off, early or not.
+        double unused = 0;
+        double left = 1;
+        for(int64_t m = 0; m < months && m <= longest && !(left <= 0); ++m)
+        {
+            left = flowMonth(balance, payment, rate, last, padded, m,
+                             smm != NULL ? smm[m] : 0.0, interest + m,
+                             principle + m,
+                             prepaid != NULL ? prepaid + m : &unused);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+LoanCents loanToCents(double amount)
+{
+    // llround() of anything outside the range of a LoanCents is undefined,
+    // and -2^63 itself is the sentinel. a NaN fails the comparison too.
+    double cents = amount * 100.0;
+    if(!(std::fabs(cents) < 0x1p63))
+    {
+        return LOAN_CENTS_INVALID;
+    }
+    return (LoanCents)std::llround(cents);
+}
+
+LoanCents loanCentPayment(LoanCents principleAmount,
+                          double yearlyInterestRate, long months)
+{
+    if(principleAmount == LOAN_CENTS_INVALID)
+    {
+        return LOAN_CENTS_INVALID;
+    }
+    return loanToCents(loanSolvePayment(principleAmount / 100.0,
+                                        yearlyInterestRate,
+                                        months).monthlyPayment);
+}
+
+void loanScheduleStart(LoanSchedule *s, LoanCents principleAmount,
+                       LoanCents monthlyPayment, double yearlyInterestRate,
+                       long months)
+{
+    s->balance = principleAmount;
+    s->payment = monthlyPayment;
+    s->rate = std::llround(yearlyInterestRate * LOAN_RATE_SCALE);
+    s->month = 0;
+    s->months = std::isfinite(yearlyInterestRate) &&
+                principleAmount != LOAN_CENTS_INVALID &&
+                monthlyPayment != LOAN_CENTS_INVALID ? months : 0;
+    s->totalPaid = 0;
+    s->interestPaid = 0;
+}
+
+long loanScheduleNext(LoanSchedule *s, LoanScheduleRow *rows, long count)
+{
+    // interest = balance * rate / (1200 * LOAN_RATE_SCALE). the product
+    // fits in 64 bits for any balance below a billion dollars or so at
+    // everyday rates; past that it is done in 128.
+    const int64_t divisor = 1200 * (int64_t)LOAN_RATE_SCALE;
+    const int64_t limit = s->rate > 0 ? (INT64_MAX - divisor) / s->rate :
+                                        INT64_MAX;
+
+    LoanCents balance = s->balance;
+    long n = 0;
+    while(n < count && s->month + n < s->months && balance > 0)
+    {
+        LoanCents interest;
+        if(balance <= limit)
+        {
+            interest = (balance * s->rate + divisor / 2) / divisor;
+        }
+        else
+        {
+            interest = (LoanCents)(((__int128)balance * s->rate +
+                                    divisor / 2) / divisor);
+        }
+        LoanCents payment = s->payment;
+        if(s->month + n + 1 == s->months || payment - interest >= balance)
+        {
+            payment = balance + interest;
+        }
+        balance -= payment - interest;
+
+        rows[n].payment = payment;
+        rows[n].interest = interest;
+        rows[n].principle = payment - interest;
+        rows[n].balance = balance;
+        s->totalPaid += payment;
+        s->interestPaid += interest;
+        ++n;
+    }
+
+    s->balance = balance;
+    s->month += n;
+    return n;
+}
+
+// ----------------------------------------------------------------------------
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1,
+// 2, 3"), a keyed scramble of a 128 bit counter. the numbers for a path
+// and step come straight from their indexes, so it doesn't matter which
+// thread gets there first.
+static void philox(uint32_t c[4], uint32_t k0, uint32_t k1)
+{
+    for(int round = 0; round < 10; ++round)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53 * c[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57 * c[2];
+        uint32_t next[4] = { (uint32_t)(p1 >> 32) ^ c[1] ^ k0, (uint32_t)p1,
+                             (uint32_t)(p0 >> 32) ^ c[3] ^ k1, (uint32_t)p0 };
+        memcpy(c, next, sizeof(next));
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+}
+
+// a standard normal number for step of path, by Box-Muller from two 53 bit
+// uniforms strictly between 0 and 1
+static double normalVariate(uint64_t seed, long path, long step)
+{
+    uint32_t c[4] = { (uint32_t)step, (uint32_t)((uint64_t)step >> 32),
+                      (uint32_t)path, (uint32_t)((uint64_t)path >> 32) };
+    philox(c, (uint32_t)seed, (uint32_t)(seed >> 32));
+
+    double u1 = ((((uint64_t)c[0] << 32 | c[1]) >> 11) + 0.5) * 0x1p-53;
+    double u2 = ((((uint64_t)c[2] << 32 | c[3]) >> 11) + 0.5) * 0x1p-53;
+    return std::sqrt(-2.0 * std::log(u1)) *
+           std::cos(6.283185307179586 * u2);
+}
+
+// the balance left after months level payments at a monthly rate, in one
+// step instead of month by month
+static double balanceAfter(double balance, double monthlyPayment,
+                           double monthlyInterestRate, long months)
+{
+    double growth = std::expm1(months * std::log1p(monthlyInterestRate));
+    return balance + balance * growth -
+           monthlyPayment * growth / monthlyInterestRate;
+}
+
+// the caps of a loan that has none
+static const LoanArmCaps noCaps = { 0, 0, 0, -HUGE_VAL };
+
+// the rate set at a reset to index plus margin, held to the caps around
+// the rate before and the initial rate, and to the floor
+static double resetRate(const LoanArm *arm, const LoanArmCaps *caps,
+                        double initialRate, double previousRate,
+                        double index, bool first)
+{
+    double rate = index + arm->margin;
+
+    double cap = first ? caps->initialCap : caps->periodicCap;
+    if(cap > 0)
+    {
+        rate = std::min(std::max(rate, previousRate - cap),
+                        previousRate + cap);
+    }
+    if(caps->lifetimeCap > 0)
+    {
+        rate = std::min(rate, initialRate + caps->lifetimeCap);
+    }
+    return std::max(rate, caps->floor);
+}
+
+// one stretch of level payments: the payment recast over the months left,
+// then the balance jumped straight to the end of the stretch. the last
+// one pays the loan off exactly, so its balance is simply 0.
+static void armPeriod(LoanArmPeriod &p, double balance, long left)
+{
+    p.payment = loanSolvePayment(balance, p.rate, left).monthlyPayment;
+    p.balance = p.months == left ? 0 :
+                balanceAfter(balance, p.payment, p.rate / 1200.0, p.months);
+    p.principle = balance - p.balance;
+    p.interest = p.payment * p.months - p.principle;
+}
+
+long loanArmPeriods(const LoanArm *arm, long months)
+{
+    if(months <= arm->fixedMonths)
+    {
+        return 1;
+    }
+    return 1 + (months - arm->fixedMonths + arm->resetMonths - 1) /
+               arm->resetMonths;
+}
+
+void loanArmPaths(const LoanArm *arm, double principleAmount,
+                  double initialRate, long months, double index,
+                  double volatility, uint64_t seed, long begin, long end,
+                  double *payments, double *interest)
+{
+    loanArmCappedPaths(arm, &noCaps, principleAmount, initialRate, months,
+                       index, volatility, seed, begin, end, payments,
+                       interest);
+}
+
+void loanArmCappedPaths(const LoanArm *arm, const LoanArmCaps *caps,
+                        double principleAmount, double initialRate,
+                        long months, double index, double volatility,
+                        uint64_t seed, long begin, long end,
+                        double *payments, double *interest)
+{
+    long periods = loanArmPeriods(arm, months);
+
+    for(long path = begin; path < end; ++path)
+    {
+        LoanArmPeriod p;
+        p.month = 0;
+        p.months = std::min(arm->fixedMonths, months);
+        p.rate = initialRate;
+        p.balance = principleAmount;
+
+        double level = index;
+        double paid = 0;
+        for(long k = 0; k < periods; ++k)
+        {
+            if(k > 0)
+            {
+                // the index has had p.months to move since the last reset
+                level += volatility * std::sqrt(p.months / 12.0) *
+                         normalVariate(seed, path, k);
+                level = std::max(level, 0.0);
+                p.rate = resetRate(arm, caps, initialRate, p.rate, level,
+                                   k == 1);
+                p.month += p.months;
+                p.months = std::min(arm->resetMonths, months - p.month);
+            }
+
+            armPeriod(p, p.balance, months - p.month);
+            payments[(path - begin) * periods + k] = p.payment;
+            paid += p.interest;
+        }
+
+        interest[path - begin] = paid;
+    }
+}
+
+long loanArmSchedule(const LoanArm *arm, double principleAmount,
+                     double initialRate, long months, const double *indexes,
+                     long indexCount, LoanArmPeriod *periods)
+{
+    return loanArmCappedSchedule(arm, &noCaps, principleAmount, initialRate,
+                                 months, indexes, indexCount, periods);
+}
+
+long loanArmCappedSchedule(const LoanArm *arm, const LoanArmCaps *caps,
+                           double principleAmount, double initialRate,
+                           long months, const double *indexes,
+                           long indexCount, LoanArmPeriod *periods)
+{
+    long count = loanArmPeriods(arm, months);
+    double balance = principleAmount;
+    long month = 0;
+
+    for(long k = 0; k < count; ++k)
+    {
+        LoanArmPeriod &p = periods[k];
+        p.month = month;
+        if(k == 0)
+        {
+            p.months = std::min(arm->fixedMonths, months);
+            p.rate = initialRate;
+        }
+        else
+        {
+            p.months = std::min(arm->resetMonths, months - month);
+            p.rate = resetRate(arm, caps, initialRate, periods[k - 1].rate,
+                               indexes[std::min(k, indexCount) - 1],
+                               k == 1);
+        }
+
+        armPeriod(p, balance, months - month);
+        balance = p.balance;
+        month += p.months;
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+
+LoanSensitivity loanPaymentSensitivity(double principleAmount,
+                                       double yearlyInterestRate,
+                                       double numberPayments)
+{
+    return sensitivityGivenFactor<LOAN_SOLVE_PAYMENT>(
+        principleAmount, yearlyInterestRate, numberPayments,
+        discountFactor(yearlyInterestRate, numberPayments));
+}
+
+LoanSensitivity loanPrincipleSensitivity(double monthlyPayment,
+                                         double numberPayments,
+                                         double yearlyInterestRate)
+{
+    return sensitivityGivenFactor<LOAN_SOLVE_PRINCIPLE>(
+        monthlyPayment, yearlyInterestRate, numberPayments,
+        discountFactor(yearlyInterestRate, numberPayments));
+}
+
+void loanSweepTermSensitivities(int solveFor, double amount,
+                                double yearlyInterestRate, double first,
+                                double step, long begin, long end,
+                                LoanResult *results,
+                                LoanSensitivity *sensitivities)
+{
+    if(solveFor == LOAN_SOLVE_PRINCIPLE)
+    {
+        sweepTerms<LOAN_SOLVE_PRINCIPLE, true>(amount, yearlyInterestRate,
+                                               first, step, begin, end,
+                                               results, sensitivities);
+    }
+    else
+    {
+        sweepTerms<LOAN_SOLVE_PAYMENT, true>(amount, yearlyInterestRate,
+                                             first, step, begin, end,
+                                             results, sensitivities);
+    }
+}
+
+void loanSweepRateSensitivities(int solveFor, double amount,
+                                double numberPayments, double first,
+                                double step, long begin, long end,
+                                LoanResult *results,
+                                LoanSensitivity *sensitivities)
+{
+    if(solveFor == LOAN_SOLVE_PRINCIPLE)
+    {
+        sweepRates<LOAN_SOLVE_PRINCIPLE, true>(amount, numberPayments, first,
+                                               step, begin, end, results,
+                                               sensitivities);
+    }
+    else
+    {
+        sweepRates<LOAN_SOLVE_PAYMENT, true>(amount, numberPayments, first,
+                                             step, begin, end, results,
+                                             sensitivities);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+// label and then value in fixed point with precision decimals, left
+// justified in a field at least 12 wide, the same way "%s%-12.2f" would
+static char *field(char *p, const char *label, double value, int precision)
+{
+    size_t length = std::strlen(label);
+    std::memcpy(p, label, length);
+    p += length;
+
+    // a double is at most 309 digits before the point
+    std::to_chars_result r = std::to_chars(p, p + 400, value,
+                                           std::chars_format::fixed,
+                                           precision);
+    length = r.ptr - p;
+    p = r.ptr;
+    if(length < 12)
+    {
+        std::memset(p, ' ', 12 - length);
+        p += 12 - length;
+    }
+    return p;
+}
+
+// the options that change what a row holds. every combination of them gets
+// its own formatRow(), so printing a sweep never tests one per row.
+#define FORMAT_OPTIONS (LOAN_SHOW_PERIOD | LOAN_SHOW_RATE | \
+                        LOAN_SHOW_SENSITIVITY | LOAN_COLUMNS_MASK)
+
+// one solved loan with its columns fixed at compile time, and its
+// sensitivities s for LOAN_SHOW_SENSITIVITY
+template<int SolveFor, int Options>
+static char *formatRow(char *p, const LoanResult *r,
+                       const LoanSensitivity *s)
+{
+    if constexpr(SolveFor == LOAN_SOLVE_PRINCIPLE)
+    {
+        p = field(p, "Principle: ", r->principleAmount, 2);
+    }
+    else
+    {
+        p = field(p, "Monthly: ", r->monthlyPayment, 2);
+    }
+
+    if constexpr((Options & LOAN_SHOW_PERIOD) != 0)
+    {
+        p = field(p, "\tNum Payments: ", r->numberPayments, 2);
+    }
+
+    if constexpr((Options & LOAN_SHOW_RATE) != 0)
+    {
+        p = field(p, "\tRate: ", r->yearlyInterestRate, 3);
+    }
+
+    constexpr int columns = Options & LOAN_COLUMNS_MASK;
+    if constexpr(columns != LOAN_COLUMNS_BARE)
+    {
+        p = field(p, "\tInterest: ", r->interestPaid, 2);
+        p = field(p, "\tTotal: ", r->totalPaid, 2);
+    }
+
+    if constexpr(columns == LOAN_COLUMNS_FULL)
+    {
+        p = field(p, "\tInterest%: ", r->interestPaidPercent, 2);
+        p = field(p, "\tBreakeven: ", r->breakEvenYears, 2);
+    }
+
+    if constexpr((Options & LOAN_SHOW_SENSITIVITY) != 0)
+    {
+        p = field(p, "\tdRate: ", s->dRate, 4);
+        p = field(p, "\tdTerm: ", s->dTerm, 4);
+        p = field(p, "\td2Rate: ", s->d2Rate, 4);
+        p = field(p, "\td2RateTerm: ", s->d2RateTerm, 4);
+        p = field(p, "\td2Term: ", s->d2Term, 4);
+    }
+    return p;
+}
+
+// count rows, each ending with a newline
+template<int SolveFor, int Options>
+static size_t formatRows(char *buffer, const LoanResult *rows,
+                         const LoanSensitivity *sensitivities, long count)
+{
+    char *p = buffer;
+    for(long i = 0; i < count; ++i)
+    {
+        if constexpr((Options & LOAN_SHOW_SENSITIVITY) != 0)
+        {
+            p = formatRow<SolveFor, Options>(p, rows + i, sensitivities + i);
+        }
+        else
+        {
+            p = formatRow<SolveFor, Options>(p, rows + i, NULL);
+        }
+        *p++ = '\n';
+    }
+    return p - buffer;
+}
+
+typedef size_t (*RowsFormatter)(char *, const LoanResult *,
+                                const LoanSensitivity *, long);
+
+// formatRows() for options, out of a table with one for every value of
+// options & FORMAT_OPTIONS
+template<int SolveFor, int... Options>
+static RowsFormatter rowsFormatter(int options,
+                                   std::integer_sequence<int, Options...>)
+{
+    static const RowsFormatter table[] = {
+        formatRows<SolveFor, Options & FORMAT_OPTIONS>...
+    };
+    return table[options & FORMAT_OPTIONS];
+}
+
+static RowsFormatter rowsFormatter(int solveFor, int options)
+{
+    typedef std::make_integer_sequence<int, FORMAT_OPTIONS + 1> Options;
+    if(solveFor == LOAN_SOLVE_PRINCIPLE)
+    {
+        return rowsFormatter<LOAN_SOLVE_PRINCIPLE>(options, Options());
+    }
+    return rowsFormatter<LOAN_SOLVE_PAYMENT>(options, Options());
+}
+
+size_t loanFormatRow(char *buffer, const LoanResult *r, int solveFor,
+                     int options)
+{
+    // without the newline, which LOAN_ROW_SIZE leaves room for
+    return loanFormatRows(buffer, r, 1, solveFor, options) - 1;
+}
+
+// the rows loanFormatRows() works out sensitivities for at a time
+#define SENSITIVITY_ROWS 64
+
+size_t loanFormatRows(char *buffer, const LoanResult *rows, long count,
+                      int solveFor, int options)
+{
+    RowsFormatter format = rowsFormatter(solveFor, options);
+    if(!(options & LOAN_SHOW_SENSITIVITY))
+    {
+        return format(buffer, rows, NULL, count);
+    }
+
+    // these rows come without sensitivities, so solve for them here
+    LoanSensitivity s[SENSITIVITY_ROWS];
+    size_t length = 0;
+    for(long i = 0; i < count; i += SENSITIVITY_ROWS)
+    {
+        long n = std::min(count - i, (long)SENSITIVITY_ROWS);
+        for(long j = 0; j < n; ++j)
+        {
+            const LoanResult &r = rows[i + j];
+            s[j] = solveFor == LOAN_SOLVE_PRINCIPLE ?
+                loanPrincipleSensitivity(r.monthlyPayment, r.numberPayments,
+                                         r.yearlyInterestRate) :
+                loanPaymentSensitivity(r.principleAmount,
+                                       r.yearlyInterestRate,
+                                       r.numberPayments);
+        }
+        length += format(buffer + length, rows + i, s, n);
+    }
+    return length;
+}
+
+size_t loanFormatSensitiveRows(char *buffer, const LoanResult *rows,
+                               const LoanSensitivity *sensitivities,
+                               long count, int solveFor, int options)
+{
+    return rowsFormatter(solveFor, options)(buffer, rows, sensitivities,
+                                            count);
+}
+
+size_t loanFormatHeading(char *buffer, double numberPayments)
+{
+    return field(buffer, "Num Payments: ", numberPayments, 2) - buffer;
+}
@@ -0,0 +1,445 @@
+/*
+   libloan
+   Steve Connet
+
+   The loan math shared by loan.c, loan.cpp and anything else that links
+   it: solvers, vectorized discount factor and rate kernels, the period
+   and rate sweeps, and the text layout of a solved row. Plain C interface,
+   so the same library serves C and C++ and can be loaded by anything that
+   speaks the C calling convention.
+
+   build the static and shared libraries with:
+   g++ -O3 -fPIC -fvisibility=hidden -c libloan.cpp
+   ar rcs libloan.a libloan.o
+   g++ -shared -Wl,-soname,libloan.so.1 -o libloan.so.1 libloan.o -lm
+   ln -sf libloan.so.1 libloan.so
+
+   the library is C++ inside, so C programs linking libloan.a statically
+   also need -lstdc++. libloan_test.cpp checks its kernels.
+
+   ABI: the structs below are frozen. they are returned by value, filled
+   in arrays whose stride is their size or allocated by the caller, so a
+   binary built against an older header would break the moment one gained
+   a field. new data comes in new structs through new functions, and the
+   functions already here never change. LOAN_VERSION is bumped whenever
+   something is added and the soname only if that promise is ever broken.
+*/
+
+#ifndef LIBLOAN_H
+#define LIBLOAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define LOAN_API __attribute__((visibility("default")))
+#else
+#define LOAN_API
+#endif
+
+#define LOAN_VERSION 12
+
+// which figure of a loan is being solved for
+#define LOAN_SOLVE_PAYMENT   0
+#define LOAN_SOLVE_PRINCIPLE 1
+#define LOAN_SOLVE_RATE      2
+#define LOAN_SOLVE_TERM      3
+
+// extra columns loanFormatRow() can print (LOAN_SHOW_SENSITIVITY is
+// LOAN_VERSION 8)
+#define LOAN_SHOW_PERIOD      0x01
+#define LOAN_SHOW_RATE        0x02
+#define LOAN_SHOW_SENSITIVITY 0x08
+
+// which of the interest, total, interest% and breakeven columns follow, in
+// the same options: all of them, only the interest and total, or none.
+// (LOAN_VERSION 9)
+#define LOAN_COLUMNS_FULL 0x00
+#define LOAN_COLUMNS_COST 0x10
+#define LOAN_COLUMNS_BARE 0x20
+#define LOAN_COLUMNS_MASK 0x30
+
+// room loanFormatRow() and loanFormatHeading() may need, whatever the
+// numbers
+#define LOAN_ROW_SIZE 4096
+
+// everything we know about a single loan once it has been solved. frozen.
+typedef struct LoanResult
+{
+    double principleAmount;
+    double monthlyPayment;
+    double numberPayments;
+    double yearlyInterestRate;
+    double totalPaid;
+    double interestPaid;
+    double interestPaidPercent;
+    double breakEvenYears;
+} LoanResult;
+
+// LOAN_VERSION of the library actually loaded
+LOAN_API int loanVersion(void);
+
+// ----------------------------------------------------------------------------
+// single loans
+
+// solve monthly payment given principle, interest and period
+LOAN_API LoanResult loanSolvePayment(double principleAmount,
+                                     double yearlyInterestRate,
+                                     double numberPayments);
+
+// solve principle given payment, period and interest
+LOAN_API LoanResult loanSolvePrinciple(double monthlyPayment,
+                                       double numberPayments,
+                                       double yearlyInterestRate);
+
+// solve interest rate given principle, payment and period. the rate is NaN
+// if the payments don't cover the principle.
+LOAN_API LoanResult loanSolveRate(double principleAmount,
+                                  double monthlyPayment,
+                                  double numberPayments);
+
+// solve number of payments given principle, payment and interest. the
+// period is usually fractional, with a smaller final payment the totals
+// account for exactly. at 0% it is principle / payment, and it is NaN if
+// the payment doesn't cover the interest.
+LOAN_API LoanResult loanSolveTerm(double principleAmount,
+                                  double monthlyPayment,
+                                  double yearlyInterestRate);
+
+// ----------------------------------------------------------------------------
+// arrays of loans
+
+// discount factors x[i] = (1 + yearlyInterestRates[i] / 1200)^-periods[i]
+LOAN_API void loanDiscountFactors(const double *yearlyInterestRates,
+                                  const double *periods, double *x,
+                                  long count);
+
+// yearly rates that pay off principles[i] with periods[i] payments of
+// payments[i], NaN where no positive rate does
+LOAN_API void loanSolveRates(const double *principles,
+                             const double *payments, const double *periods,
+                             double *yearlyInterestRates, long count);
+
+// loanSolveTerm() of each principles[i], payments[i] and
+// yearlyInterestRates[i] into results[i], vectorized (LOAN_VERSION 7)
+LOAN_API void loanSolveTerms(const double *principles,
+                             const double *payments,
+                             const double *yearlyInterestRates,
+                             LoanResult *results, long count);
+
+// rows [begin, end) of a sweep over periods first, first + step, ... at a
+// fixed rate, solving LOAN_SOLVE_PAYMENT or LOAN_SOLVE_PRINCIPLE for
+// amount, into results[0 .. end - begin)
+LOAN_API void loanSweepTerms(int solveFor, double amount,
+                             double yearlyInterestRate, double first,
+                             double step, long begin, long end,
+                             LoanResult *results);
+
+// the same over rates first, first + step, ... at a fixed period
+LOAN_API void loanSweepRates(int solveFor, double amount,
+                             double numberPayments, double first,
+                             double step, long begin, long end,
+                             LoanResult *results);
+
+// ----------------------------------------------------------------------------
+// sensitivities (LOAN_VERSION 8)
+
+// first and second derivatives of a solved payment or principle with
+// respect to the yearly rate, in percent, and the number of payments,
+// found exactly by forward mode automatic differentiation rather than by
+// bumping the inputs and solving again. frozen.
+typedef struct LoanSensitivity
+{
+    double dRate;
+    double dTerm;
+    double d2Rate;
+    double d2RateTerm;
+    double d2Term;
+} LoanSensitivity;
+
+// of the monthly payment loanSolvePayment() gives
+LOAN_API LoanSensitivity loanPaymentSensitivity(double principleAmount,
+                                                double yearlyInterestRate,
+                                                double numberPayments);
+
+// of the principle loanSolvePrinciple() gives
+LOAN_API LoanSensitivity loanPrincipleSensitivity(double monthlyPayment,
+                                                  double numberPayments,
+                                                  double yearlyInterestRate);
+
+// loanSweepTerms() and loanSweepRates() that also fill
+// sensitivities[0 .. end - begin) with those of each row, from the same
+// discount factors the rows are solved with (LOAN_VERSION 12)
+LOAN_API void loanSweepTermSensitivities(int solveFor, double amount,
+                                         double yearlyInterestRate,
+                                         double first, double step,
+                                         long begin, long end,
+                                         LoanResult *results,
+                                         LoanSensitivity *sensitivities);
+
+LOAN_API void loanSweepRateSensitivities(int solveFor, double amount,
+                                         double numberPayments,
+                                         double first, double step,
+                                         long begin, long end,
+                                         LoanResult *results,
+                                         LoanSensitivity *sensitivities);
+
+// ----------------------------------------------------------------------------
+// text
+
+// one solved loan as a line of text without the newline, led by the
+// principle for LOAN_SOLVE_PRINCIPLE and by the payment otherwise, whose
+// sensitivities LOAN_SHOW_SENSITIVITY works out and adds at the end. buffer
+// needs LOAN_ROW_SIZE bytes; returns the length, no terminating 0.
+LOAN_API size_t loanFormatRow(char *buffer, const LoanResult *r,
+                              int solveFor, int options);
+
+// count rows the same way, each ending with a newline, with the choice of
+// columns made once for all of them. buffer needs count * LOAN_ROW_SIZE
+// bytes. (LOAN_VERSION 9)
+LOAN_API size_t loanFormatRows(char *buffer, const LoanResult *rows,
+                               long count, int solveFor, int options);
+
+// loanFormatRows() adding sensitivities[i] to rows[i] for
+// LOAN_SHOW_SENSITIVITY, as they were solved, rather than working them
+// out. sensitivities may be NULL without it. (LOAN_VERSION 12)
+LOAN_API size_t loanFormatSensitiveRows(char *buffer,
+                                        const LoanResult *rows,
+                                        const LoanSensitivity *sensitivities,
+                                        long count, int solveFor,
+                                        int options);
+
+// the "Num Payments:" line above each block of a full grid, the same way
+LOAN_API size_t loanFormatHeading(char *buffer, double numberPayments);
+
+// add the scheduled cash flows of count loans into interest[m] and
+// principle[m] for months m = 0 (the first payment) .. months - 1. the
+// loans pay their level payments[i], the last of ceil(periods[i]) trued up
+// to whatever balance is left, as in an amortization schedule. a payment
+// never takes more principle than is left, so a loan paying more than its
+// level payment is paid off early and has no flows after that.
+// (LOAN_VERSION 3)
+LOAN_API void loanCashFlows(const double *principles, const double *payments,
+                            const double *yearlyInterestRates,
+                            const double *periods, long count,
+                            double *interest, double *principle,
+                            long months);
+
+// the single monthly mortality, the fraction of a balance prepaid each
+// month, of a conditional prepayment rate cpr in percent a year
+// (LOAN_VERSION 4)
+LOAN_API double loanMonthlyPrepayment(double cpr);
+
+// the same with smm[m] of each loan's balance, once its month m payment
+// has been made, prepaid into prepaid[m]. what is left keeps amortizing to
+// the same last month, so the level payments shrink in proportion. smm may
+// be NULL for no prepayments, prepaid NULL if they aren't wanted.
+// (LOAN_VERSION 4)
+LOAN_API void loanPrepaidCashFlows(const double *principles,
+                                   const double *payments,
+                                   const double *yearlyInterestRates,
+                                   const double *periods, long count,
+                                   const double *smm, double *interest,
+                                   double *principle, double *prepaid,
+                                   long months);
+
+// ----------------------------------------------------------------------------
+// cent exact schedules (LOAN_VERSION 2)
+
+// money as a whole number of cents
+typedef int64_t LoanCents;
+
+// what loanToCents() gives an amount that isn't a number or is too big,
+// 2^63 cents or more either way, to be held in cents (LOAN_VERSION 11)
+#define LOAN_CENTS_INVALID INT64_MIN
+
+// yearly rates are taken to this many parts of a percent, ie. five
+// decimals, the way servicers quote them
+#define LOAN_RATE_SCALE 100000
+
+// one month of a schedule. frozen.
+typedef struct LoanScheduleRow
+{
+    LoanCents payment;
+    LoanCents interest;
+    LoanCents principle;
+    LoanCents balance;
+} LoanScheduleRow;
+
+// a schedule being worked through month by month, and what has been paid
+// so far. only loanScheduleStart() and loanScheduleNext() write it, but
+// callers allocate it, so it is frozen too.
+typedef struct LoanSchedule
+{
+    LoanCents balance;
+    LoanCents payment;
+    int64_t rate;
+    long month;
+    long months;
+    LoanCents totalPaid;
+    LoanCents interestPaid;
+} LoanSchedule;
+
+// amount rounded to the nearest cent, LOAN_CENTS_INVALID if it can't be
+LOAN_API LoanCents loanToCents(double amount);
+
+// the level monthly payment rounded to the nearest cent, LOAN_CENTS_INVALID
+// if it can't be or principleAmount is
+LOAN_API LoanCents loanCentPayment(LoanCents principleAmount,
+                                   double yearlyInterestRate, long months);
+
+// start the schedule of a loan billed the way a servicer does it: each
+// month's interest is the balance times the monthly rate rounded half up
+// to the cent, the rest of the payment comes off the balance, and the
+// final payment is trued up to exactly what is left. a loan paid off
+// early stops early, and one whose rate isn't a number, or whose
+// principleAmount or monthlyPayment is LOAN_CENTS_INVALID, has no schedule.
+LOAN_API void loanScheduleStart(LoanSchedule *s, LoanCents principleAmount,
+                                LoanCents monthlyPayment,
+                                double yearlyInterestRate, long months);
+
+// the next rows of the schedule, at most count of them. returns how many,
+// 0 once the loan is paid off.
+LOAN_API long loanScheduleNext(LoanSchedule *s, LoanScheduleRow *rows,
+                               long count);
+
+// ----------------------------------------------------------------------------
+// adjustable rates (LOAN_VERSION 5)
+
+// the terms of an adjustable rate loan: the initial rate holds for the
+// first fixedMonths payments, then every resetMonths the rate is reset to
+// the index plus margin and the payment recast over the months left.
+// frozen, which is why the caps are a LoanArmCaps of their own.
+typedef struct LoanArm
+{
+    long fixedMonths;
+    long resetMonths;
+    double margin;
+} LoanArm;
+
+// the limits on the rate of an adjustable rate loan: the first reset moves
+// it at most initialCap percentage points, later ones at most periodicCap;
+// it never rises more than lifetimeCap over the initial rate nor falls
+// below floor. a cap of 0 is no cap. frozen. (LOAN_VERSION 10)
+typedef struct LoanArmCaps
+{
+    double initialCap;
+    double periodicCap;
+    double lifetimeCap;
+    double floor;
+} LoanArmCaps;
+
+// one stretch of level payments of an adjustable rate loan, from payment
+// month (counting from 0) for months payments. interest and principle are
+// what the stretch pays in all and balance what is left after it. frozen.
+// (LOAN_VERSION 6)
+typedef struct LoanArmPeriod
+{
+    long month;
+    long months;
+    double rate;
+    double payment;
+    double interest;
+    double principle;
+    double balance;
+} LoanArmPeriod;
+
+// how many stretches of level payments, the first at the initial rate, a
+// loan of months payments has under arm
+LOAN_API long loanArmPeriods(const LoanArm *arm, long months);
+
+// simulate paths [begin, end) of an adjustable rate loan of principleAmount
+// over months payments, starting at initialRate. the index starts at index
+// and moves at each reset by a normal step of volatility percentage points
+// a year, scaled to the months since the last, and never goes below 0.
+// payments[(path - begin) * loanArmPeriods() + k] is the payment of period
+// k of a path and interest[path - begin] all the interest it pays. the
+// random numbers are counter based on seed, path and period, so a path
+// comes out the same whichever call or thread simulates it.
+LOAN_API void loanArmPaths(const LoanArm *arm, double principleAmount,
+                           double initialRate, long months, double index,
+                           double volatility, uint64_t seed, long begin,
+                           long end, double *payments, double *interest);
+
+// the same with the rate held to caps (LOAN_VERSION 10)
+LOAN_API void loanArmCappedPaths(const LoanArm *arm, const LoanArmCaps *caps,
+                                 double principleAmount, double initialRate,
+                                 long months, double index,
+                                 double volatility, uint64_t seed,
+                                 long begin, long end, double *payments,
+                                 double *interest);
+
+// the schedule of an adjustable rate loan, one LoanArmPeriod per
+// loanArmPeriods() into periods, the index at reset k being
+// indexes[k - 1], or the last of the indexCount given once they run out.
+// each period is worked out in closed form rather than month by month, so
+// a 30 year 5/1 loan takes 26 payment and 25 balance evaluations.
+// returns how many periods. (LOAN_VERSION 6)
+LOAN_API long loanArmSchedule(const LoanArm *arm, double principleAmount,
+                              double initialRate, long months,
+                              const double *indexes, long indexCount,
+                              LoanArmPeriod *periods);
+
+// the same with the rate held to caps (LOAN_VERSION 10)
+LOAN_API long loanArmCappedSchedule(const LoanArm *arm,
+                                    const LoanArmCaps *caps,
+                                    double principleAmount,
+                                    double initialRate, long months,
+                                    const double *indexes, long indexCount,
+                                    LoanArmPeriod *periods);
+
+// ----------------------------------------------------------------------------
+// closed forms given the discount factor x = (1 + monthly rate)^-period,
+// inline so tight loops over cached factors don't pay for a call
+
+// fill in the summary figures once principle and payment are both known
+static inline void loanTotals(LoanResult *r)
+{
+    r->totalPaid = r->monthlyPayment * r->numberPayments;
+    r->interestPaid = r->totalPaid - r->principleAmount;
+    r->interestPaidPercent = (r->interestPaid / r->principleAmount) * 100.0;
+
+    r->breakEvenYears = (r->principleAmount / r->monthlyPayment) / 12.0;
+}
+
+static inline LoanResult loanPaymentGivenFactor(double principleAmount,
+                                                double yearlyInterestRate,
+                                                double numberPayments,
+                                                double x)
+{
+    LoanResult r;
+    double monthlyInterestRate = yearlyInterestRate / 1200.0;
+
+    r.principleAmount = principleAmount;
+    r.monthlyPayment = principleAmount * monthlyInterestRate / (1 - x);
+    r.numberPayments = numberPayments;
+    r.yearlyInterestRate = yearlyInterestRate;
+    loanTotals(&r);
+    return r;
+}
+
+static inline LoanResult loanPrincipleGivenFactor(double monthlyPayment,
+                                                  double numberPayments,
+                                                  double yearlyInterestRate,
+                                                  double x)
+{
+    LoanResult r;
+    double monthlyInterestRate = yearlyInterestRate / 1200.0;
+
+    r.principleAmount = monthlyPayment * (1 - x) / monthlyInterestRate;
+    r.monthlyPayment = monthlyPayment;
+    r.numberPayments = numberPayments;
+    r.yearlyInterestRate = yearlyInterestRate;
+    loanTotals(&r);
+    return r;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
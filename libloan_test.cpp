@@ -0,0 +1,367 @@
+/*
+   libloan_test
+   Steve Connet
+
+   Checks the vectorized kernels of libloan against long double references:
+   simdExp(), simdLog() and log1pSeries() within a few ulps, and
+   loanDiscountFactors() and loanSolveTerms() against pow() and
+   loanSolveTerm() within a relative bound, the sensitivities the sweeps
+   solve against loanPaymentSensitivity(), loanPrincipleSensitivity() and
+   central differences, and that loanToCents() turns away amounts that
+   can't be held in cents. Prints each check and the worst
+   error it saw, and exits non-zero if any is out of bounds.
+
+   compile with:
+   g++ -O3 -o libloan_test libloan_test.cpp
+*/
+
+#include "libloan.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// a deterministic stream of uniforms in [0, 1), so a failure can be rerun
+class Uniform
+{
+public:
+    explicit Uniform(uint64_t seed) : state(seed) {}
+
+    // splitmix64
+    double operator()()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        return (z >> 11) * 0x1p-53;
+    }
+
+    double operator()(double lo, double hi)
+    {
+        return lo + (hi - lo) * (*this)();
+    }
+
+private:
+    uint64_t state;
+};
+
+// how far got is from the exact value, in units of the last place of the
+// exact value rounded to a double
+static double ulps(double got, long double exact)
+{
+    double rounded = (double)exact;
+    double ulp = std::nextafter(std::fabs(rounded), INFINITY) -
+                 std::fabs(rounded);
+    return (double)(std::fabs(got - exact) / ulp);
+}
+
+static double relative(double got, double exact)
+{
+    return exact == 0 ? std::fabs(got) : std::fabs(got - exact) /
+                                         std::fabs(exact);
+}
+
+static int failures = 0;
+
+// report the worst error of one check against its bound
+static void check(const char *name, double worst, double bound,
+                  const char *unit)
+{
+    bool ok = worst <= bound;
+    std::printf("%-46s worst %.3g %s (bound %.3g)  %s\n", name, worst, unit,
+                bound, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+// ----------------------------------------------------------------------------
+
+static void testExp()
+{
+    Uniform u(1);
+    double worst = 0;
+    for(int i = 0; i < 1000000; ++i)
+    {
+        double y = u(-707.0, 707.0);
+        worst = std::max(worst, ulps(simdExp(y), std::exp((long double)y)));
+    }
+    check("simdExp, |y| < 707", worst, 2.0, "ulp");
+}
+
+static void testLog()
+{
+    Uniform u(2);
+    double worst = 0;
+    for(int i = 0; i < 1000000; ++i)
+    {
+        // over every exponent, and closely around 1 where log() is small
+        double y = i % 2 == 0 ? std::exp2(u(-1020.0, 1020.0)) :
+                                u(0.5, 2.0);
+        worst = std::max(worst, ulps(simdLog(y), std::log((long double)y)));
+    }
+    check("simdLog, 2^-1020 < y < 2^1020", worst, 4.0, "ulp");
+}
+
+static void testLog1pSeries()
+{
+    Uniform u(3);
+    double worst = 0;
+    for(int i = 0; i < 1000000; ++i)
+    {
+        double r = u(0.0, SIMD_MAX_MONTHLY_RATE);
+        if(r == 0)
+        {
+            continue;
+        }
+        worst = std::max(worst, ulps(log1pSeries(r),
+                                     std::log1p((long double)r)));
+    }
+    check("log1pSeries, 0 < r <= SIMD_MAX_MONTHLY_RATE", worst, 4.0, "ulp");
+}
+
+// ----------------------------------------------------------------------------
+
+static void testDiscountFactors()
+{
+    const long COUNT = 100000;
+    std::vector<double> rates(COUNT);
+    std::vector<double> periods(COUNT);
+    std::vector<double> x(COUNT);
+
+    // everyday loans, loans at the edges of the vector kernel and past
+    // them, where pow() takes over, and the standard grid
+    Uniform u(4);
+    for(long i = 0; i < COUNT; ++i)
+    {
+        switch(i % 4)
+        {
+            case 0:
+                rates[i] = u(0.01, 30.0);
+                periods[i] = std::floor(u(1.0, 481.0));
+                break;
+            case 1:
+                rates[i] = u(0.0, SIMD_MAX_MONTHLY_RATE * 1200.0);
+                periods[i] = u(-SIMD_MAX_PERIOD, SIMD_MAX_PERIOD);
+                break;
+            case 2:
+                rates[i] = u(SIMD_MAX_MONTHLY_RATE * 1200.0, 300.0);
+                periods[i] = u(1.0, 100.0);
+                break;
+            case 3:
+                rates[i] = std::floor(u(1.0, TABLE_RATES + 1.0)) /
+                           TABLE_RATE_STEPS;
+                periods[i] = 12.0 * std::floor(u(1.0, TABLE_TERMS + 1.0));
+                break;
+        }
+    }
+
+    loanDiscountFactors(rates.data(), periods.data(), x.data(), COUNT);
+
+    // the error of the exponent grows with the period, so the bound is
+    // relative rather than in ulps
+    double worst = 0;
+    for(long i = 0; i < COUNT; ++i)
+    {
+        long double exact = std::pow(1 + (long double)rates[i] / 1200.0L,
+                                     -(long double)periods[i]);
+        worst = std::max(worst, relative(x[i], (double)exact));
+    }
+    check("loanDiscountFactors against pow", worst, 1e-12, "relative");
+}
+
+static void testSolveTerms()
+{
+    const long COUNT = 100000;
+    std::vector<double> principles(COUNT);
+    std::vector<double> payments(COUNT);
+    std::vector<double> rates(COUNT);
+    std::vector<LoanResult> results(COUNT);
+
+    // one loan in eight at 0%, one in sixteen whose payment doesn't cover
+    // the interest
+    Uniform u(5);
+    for(long i = 0; i < COUNT; ++i)
+    {
+        principles[i] = u(1000.0, 1000000.0);
+        rates[i] = i % 8 == 0 ? 0.0 : u(0.01, 30.0);
+        double interest = principles[i] * rates[i] / 1200.0;
+        payments[i] = i % 16 == 1 ? interest * u(0.5, 1.0) :
+                      interest + principles[i] * u(0.001, 0.2);
+    }
+
+    loanSolveTerms(principles.data(), payments.data(), rates.data(),
+                   results.data(), COUNT);
+
+    double worst = 0;
+    long mismatched = 0;
+    for(long i = 0; i < COUNT; ++i)
+    {
+        LoanResult one = loanSolveTerm(principles[i], payments[i], rates[i]);
+        const LoanResult &r = results[i];
+
+        // both NaN, or both numbers close together
+        if(std::isnan(one.numberPayments) != std::isnan(r.numberPayments))
+        {
+            ++mismatched;
+            continue;
+        }
+        if(std::isnan(one.numberPayments))
+        {
+            continue;
+        }
+
+        // the interest is the total less the principle, so it can only be
+        // as close as the total is, relative to the total
+        worst = std::max(worst, relative(r.numberPayments,
+                                         one.numberPayments));
+        worst = std::max(worst, relative(r.totalPaid, one.totalPaid));
+        worst = std::max(worst, std::fabs(r.interestPaid - one.interestPaid) /
+                                one.totalPaid);
+    }
+    check("loanSolveTerms against loanSolveTerm", worst, 1e-10, "relative");
+    check("loanSolveTerms NaN where loanSolveTerm is", mismatched, 0,
+          "loans");
+}
+
+// ----------------------------------------------------------------------------
+
+// the largest relative difference between two sets of sensitivities
+static double relative(const LoanSensitivity &got,
+                       const LoanSensitivity &exact)
+{
+    double worst = relative(got.dRate, exact.dRate);
+    worst = std::max(worst, relative(got.dTerm, exact.dTerm));
+    worst = std::max(worst, relative(got.d2Rate, exact.d2Rate));
+    worst = std::max(worst, relative(got.d2RateTerm, exact.d2RateTerm));
+    return std::max(worst, relative(got.d2Term, exact.d2Term));
+}
+
+// the solved payment, or principle, of amount
+static double solved(int solveFor, double amount, double yearlyInterestRate,
+                     double numberPayments)
+{
+    return solveFor == LOAN_SOLVE_PRINCIPLE ?
+        loanSolvePrinciple(amount, numberPayments,
+                           yearlyInterestRate).principleAmount :
+        loanSolvePayment(amount, yearlyInterestRate,
+                         numberPayments).monthlyPayment;
+}
+
+static void testSweepSensitivities()
+{
+    const long COUNT = 1000;
+    std::vector<LoanResult> results(COUNT);
+    std::vector<LoanSensitivity> sensitivities(COUNT);
+
+    double worst = 0;
+    double worstDifference = 0;
+    for(int solveFor = LOAN_SOLVE_PAYMENT; solveFor <= LOAN_SOLVE_PRINCIPLE;
+        ++solveFor)
+    {
+        double amount = solveFor == LOAN_SOLVE_PRINCIPLE ? 1500.0 : 250000.0;
+        for(int sweep = 0; sweep < 2; ++sweep)
+        {
+            // rates from 1% to 30% at 360 months, or periods from 12
+            // months to 80 years at 6.5%
+            if(sweep == 0)
+            {
+                loanSweepRateSensitivities(solveFor, amount, 360.0, 1.0,
+                                           0.029, 0, COUNT, results.data(),
+                                           sensitivities.data());
+            }
+            else
+            {
+                loanSweepTermSensitivities(solveFor, amount, 6.5, 12.0, 0.949,
+                                           0, COUNT, results.data(),
+                                           sensitivities.data());
+            }
+
+            for(long i = 0; i < COUNT; ++i)
+            {
+                const LoanResult &r = results[i];
+                double rate = r.yearlyInterestRate;
+                double period = r.numberPayments;
+                LoanSensitivity one = solveFor == LOAN_SOLVE_PRINCIPLE ?
+                    loanPrincipleSensitivity(amount, period, rate) :
+                    loanPaymentSensitivity(amount, rate, period);
+                worst = std::max(worst, relative(sensitivities[i], one));
+
+                double h = 1e-5 * rate;
+                double dRate = (solved(solveFor, amount, rate + h, period) -
+                                solved(solveFor, amount, rate - h, period)) /
+                               (2 * h);
+                h = 1e-5 * period;
+                double dTerm = (solved(solveFor, amount, rate, period + h) -
+                                solved(solveFor, amount, rate, period - h)) /
+                               (2 * h);
+                worstDifference = std::max(worstDifference,
+                    relative(sensitivities[i].dRate, dRate));
+                worstDifference = std::max(worstDifference,
+                    relative(sensitivities[i].dTerm, dTerm));
+            }
+        }
+    }
+    // the rows' factors come from different kernels, and the cross
+    // derivative passes through 0 along the way
+    check("sweep sensitivities against one loan's", worst, 1e-9,
+          "relative");
+    check("sweep sensitivities against differences", worstDifference, 1e-6,
+          "relative");
+}
+
+// ----------------------------------------------------------------------------
+
+static void testToCents()
+{
+    // either side of 2^63 cents, and what isn't a number
+    const double LARGEST = 0x1p63 / 100.0;
+    struct { double amount; bool valid; } amounts[] =
+    {
+        { 0.0, true },
+        { 1234.565, true },
+        { -1234.565, true },
+        { 9.2e16, true },
+        { -9.2e16, true },
+        { std::nextafter(LARGEST, 0.0), true },
+        { -std::nextafter(LARGEST, 0.0), true },
+        { LARGEST, false },
+        { -LARGEST, false },
+        { 9.3e16, false },
+        { 1e17, false },
+        { -1e17, false },
+        { INFINITY, false },
+        { -INFINITY, false },
+        { NAN, false },
+    };
+
+    long wrong = 0;
+    for(const auto &a : amounts)
+    {
+        LoanCents cents = loanToCents(a.amount);
+        wrong += (cents != LOAN_CENTS_INVALID) != a.valid;
+        wrong += a.valid && std::fabs(cents - a.amount * 100.0) > 0.5;
+    }
+    check("loanToCents LOAN_CENTS_INVALID past 2^63 cents", wrong, 0,
+          "amounts");
+
+    // and a schedule of one of those has no rows
+    LoanSchedule s;
+    LoanScheduleRow rows[12];
+    loanScheduleStart(&s, loanToCents(1e17),
+                      loanCentPayment(loanToCents(1e17), 5.0, 12), 5.0, 12);
+    check("loanScheduleNext of LOAN_CENTS_INVALID",
+          loanScheduleNext(&s, rows, 12), 0, "rows");
+}
+
+int main()
+{
+    testExp();
+    testLog();
+    testLog1pSeries();
+    testDiscountFactors();
+    testSolveTerms();
+    testSweepSensitivities();
+    testToCents();
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
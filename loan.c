@@ -4,8 +4,11 @@
 
    Determines your monthly payment of a simple loan.
 
-   compile with:
-   cc -O2 -o loan loan.c -lm
+   compile with the library built as libloan.h describes:
+   cc -O2 -o loan loan.c libloan.a -lstdc++ -lm
+
+   or against the shared one:
+   cc -O2 -o loan loan.c -L. -lloan
 
    The following functions are supported:
 
@@ -27,9 +30,11 @@
 
 #include <unistd.h> // getopt
 
+#include "libloan.h"
+
 #define SHOW_DEFAULT 0x00
-#define SHOW_PERIOD  0x01
-#define SHOW_RATE    0x02
+#define SHOW_PERIOD  LOAN_SHOW_PERIOD
+#define SHOW_RATE    LOAN_SHOW_RATE
 
 void usage()
 {
@@ -56,73 +61,88 @@ void help()
 
 // ----------------------------------------------------------------------------
 
-// calculate monthly payment given interest and period
-void calcPayment(double principleAmount, double yearlyInterestRate,
-                 double numberPayments, int options)
+// the sweeps: periods 12 to 360 in steps of 12, rates 1% to 25% in steps of 1%
+#define TERMS 30
+#define RATES 25
+
+// print a solved loan, led by the figure that was solved for
+void printLoan(const LoanResult *r, int solveFor, int options)
 {
-    double monthlyInterestRate = yearlyInterestRate / 1200.0;
-    double x = pow(1 + monthlyInterestRate, -numberPayments);
-    double monthlyPayment = principleAmount * monthlyInterestRate / (1 - x);
+    char row[LOAN_ROW_SIZE];
+    fwrite(row, 1, loanFormatRow(row, r, solveFor, options), stdout);
+    putchar('\n');
+}
 
-    double totalPaid = monthlyPayment * numberPayments;
-    double interestPaid = totalPaid - principleAmount;
-    double interestPaidPercent = (interestPaid / principleAmount) * 100.0;
+// print every period at a fixed rate
+void sweepTerms(int solveFor, double amount, double yearlyInterestRate)
+{
+    LoanResult rows[TERMS];
+    int i;
 
-    double breakEvenYears = (principleAmount / monthlyPayment) / 12.0;
+    loanSweepTerms(solveFor, amount, yearlyInterestRate, 12.0, 12.0, 0,
+                   TERMS, rows);
+    for(i = 0; i < TERMS; ++i)
+    {
+        printLoan(&rows[i], solveFor, SHOW_PERIOD);
+    }
+}
 
-    printf("Monthly: %-12.2f\t", monthlyPayment);
+// print every rate at a fixed period
+void sweepRates(int solveFor, double amount, double numberPayments)
+{
+    LoanResult rows[RATES];
+    int i;
 
-    if(options & SHOW_PERIOD)
+    loanSweepRates(solveFor, amount, numberPayments, 1.0, 1.0, 0, RATES,
+                   rows);
+    for(i = 0; i < RATES; ++i)
     {
-        printf("Num Payments: %-12.2f\t", numberPayments);
+        printLoan(&rows[i], solveFor, SHOW_RATE);
     }
+}
+
+// print every rate at every period, a block per period
+void sweepGrid(int solveFor, double amount)
+{
+    char heading[LOAN_ROW_SIZE];
+    int i;
 
-    if(options & SHOW_RATE)
+    for(i = 1; i <= TERMS; ++i)
     {
-        printf("Rate: %-12.2f\t", yearlyInterestRate);
+        fwrite(heading, 1, loanFormatHeading(heading, 12.0 * i), stdout);
+        putchar('\n');
+        sweepRates(solveFor, amount, 12.0 * i);
+        putchar('\n');
     }
+}
+
+// ----------------------------------------------------------------------------
 
-    printf("Interest: %-12.2f\tTotal: %-12.2f\tInterest%%: %-12.2f"
-           "\tBreakeven: %-12.2f\n",
-           interestPaid, totalPaid, interestPaidPercent, breakEvenYears);
+// calculate monthly payment given interest and period
+void calcPayment(double principleAmount, double yearlyInterestRate,
+                 double numberPayments, int options)
+{
+    LoanResult r = loanSolvePayment(principleAmount, yearlyInterestRate,
+                                    numberPayments);
+    printLoan(&r, LOAN_SOLVE_PAYMENT, options);
 }
 
 // calculate monthly payment given interest
 void calcPaymentAndPeriod(double principleAmount, double yearlyInterestRate)
 {
-    double numberPayments = 12;
-    while(numberPayments <= 360)
-    {
-        calcPayment(principleAmount, yearlyInterestRate, numberPayments,
-                    SHOW_PERIOD);
-        numberPayments += 12.0;
-    }
+    sweepTerms(LOAN_SOLVE_PAYMENT, principleAmount, yearlyInterestRate);
 }
 
 // calculate monthly payment given period
 void calcPaymentAndInterest(double principleAmount, double numberPayments)
 {
-    double interestRate = 1.0;
-    while(interestRate < 26.0)
-    {
-        calcPayment(principleAmount, interestRate, numberPayments,
-                    SHOW_RATE);
-        interestRate += 1.0;
-    }
+    sweepRates(LOAN_SOLVE_PAYMENT, principleAmount, numberPayments);
 }
 
 // calculate payment, period, and interest
 void calcPaymentPeriodAndInterest(double principleAmount)
 {
-    double numberPayments = 12;
-    while(numberPayments <= 360)
-    {
-        printf("Num Payments: %-12.2f\n", numberPayments);
-        calcPaymentAndInterest(principleAmount, numberPayments);
-        numberPayments += 12.0;
-
-        printf("\n");
-    }
+    sweepGrid(LOAN_SOLVE_PAYMENT, principleAmount);
 }
 
 // ----------------------------------------------------------------------------
@@ -131,69 +151,27 @@ void calcPaymentPeriodAndInterest(double principleAmount)
 void calcPrinciple(double monthlyPayment, double numberPayments,
                    double yearlyInterestRate, int options)
 {
-    double monthlyInterestRate = yearlyInterestRate / 1200.0;
-    double x = pow(1 + monthlyInterestRate, -numberPayments);
-    double principleAmount =  monthlyPayment * (1 - x) / monthlyInterestRate;
-
-    double totalPaid = monthlyPayment * numberPayments;
-    double interestPaid = totalPaid - principleAmount;
-    double interestPaidPercent = (interestPaid / principleAmount) * 100.0;
-
-    double breakEvenYears = (principleAmount / monthlyPayment) / 12.0;
-
-    printf("Principle: %-12.2f\t", principleAmount);
-
-    if(options & SHOW_PERIOD)
-    {
-        printf("Num Payments: %-12.2f\t", numberPayments);
-    }
-
-    if(options & SHOW_RATE)
-    {
-        printf("Rate: %-12.2f\t", yearlyInterestRate);
-    }
-
-    printf("Interest: %-12.2f\tTotal: %-12.2f\tInterest%%: %-12.2f\t"
-           "Breakeven: %-12.2f\n",
-           interestPaid, totalPaid, interestPaidPercent, breakEvenYears);
+    LoanResult r = loanSolvePrinciple(monthlyPayment, numberPayments,
+                                      yearlyInterestRate);
+    printLoan(&r, LOAN_SOLVE_PRINCIPLE, options);
 }
 
 // calculate principle and interest given period
 void calcPrincipleAndInterest(double monthlyPayment, double numberPayments)
 {
-    double interestRate = 1.0;
-    while(interestRate < 25.0)
-    {
-        calcPrinciple(monthlyPayment, numberPayments, interestRate,
-                      SHOW_RATE);
-        interestRate += 1.0;
-    }
+    sweepRates(LOAN_SOLVE_PRINCIPLE, monthlyPayment, numberPayments);
 }
 
 // calculate principle and period given interest
 void calcPrincipleAndPeriod(double monthlyPayment, double yearlyInterestRate)
 {
-    double numberPayments = 12;
-    while(numberPayments <= 360)
-    {
-        calcPrinciple(monthlyPayment, numberPayments, yearlyInterestRate,
-                      SHOW_PERIOD);
-        numberPayments += 12.0;
-    }
+    sweepTerms(LOAN_SOLVE_PRINCIPLE, monthlyPayment, yearlyInterestRate);
 }
 
 // calculate principle, period, and interest
 void calcPrinciplePeriodAndInterest(double monthlyPayment)
 {
-    double numberPayments = 12;
-    while(numberPayments <= 360)
-    {
-        printf("Num Payments: %-12.2f\n", numberPayments);
-        calcPrincipleAndInterest(monthlyPayment, numberPayments);
-        numberPayments += 12.0;
-
-        printf("\n");
-    }
+    sweepGrid(LOAN_SOLVE_PRINCIPLE, monthlyPayment);
 }
 
 // ----------------------------------------------------------------------------
@@ -5,7 +5,10 @@
    Determines your monthly payment of a simple loan.
 
    compile with:
-   g++ -O2 -o loan loan.cpp -lm
+   g++ -O3 -pthread -o loan loan.cpp libloan.cpp
+
+   or against the library built as libloan.h describes:
+   g++ -O3 -pthread -o loan loan.cpp libloan.a
 
    The following functions are supported:
 
@@ -18,30 +21,141 @@
    6. calculate principle and interest given period
    7. calculate principle and period given interest
    8. calculate principle, period, and interest
+
+   9. calculate payment or principle for every loan in a batch file
+  10. amortization schedule, exact to the cent, of one loan or every loan
+      in a batch file
+  11. calculate interest rate given principle, payment and period
+  12. calculate period given principle, payment and interest
+
+  13. answer any of 1, 5, 11 and 12 over a unix socket
+  14. answer any of 1, 5, 11 and 12 for each line of stdin
+  15. write the results of any of the above but 10, 13 and 14 as binary
+      columns instead of text (-f columns)
+  16. add up the month by month interest and principle cash flows of every
+      loan in a file, as scheduled or under prepayment assumptions
+  17. schedule of an adjustable rate loan with caps and floors, or its
+      payments simulated over many index paths
+  18. how much sooner extra monthly payments or a lump sum pay off a loan
+      and how much interest they save
+  19. add the rate and period sensitivities of the payment or principle to
+      any of 1 to 12 (-g)
+  20. choose which columns follow the payment or principle (-k)
 */
 
 #include <iostream>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
-#include <iomanip>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <charconv>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include <cerrno>
 
-#include <unistd.h> // getopt
+#include <csignal>
+
+#include <unistd.h> // getopt, write
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "libloan.h"
 
 #define SHOW_DEFAULT 0x00
-#define SHOW_PERIOD  0x01
-#define SHOW_RATE    0x02
+#define SHOW_PERIOD  LOAN_SHOW_PERIOD
+#define SHOW_RATE    LOAN_SHOW_RATE
+#define SHOW_SENSITIVITY LOAN_SHOW_SENSITIVITY
+#define SHOW_COLUMNS     LOAN_COLUMNS_MASK
+
+// the options above are loanFormatRow()'s own. the schedule is printed
+// here, so its bit is ours and is taken off before the library sees them.
+#define SHOW_FORMAT   (SHOW_PERIOD | SHOW_RATE | SHOW_SENSITIVITY | \
+                       SHOW_COLUMNS)
+#define SHOW_SCHEDULE 0x100
+
+static_assert((SHOW_SCHEDULE & SHOW_FORMAT) == 0,
+              "SHOW_SCHEDULE overlaps an option of loanFormatRow()");
+
+#define SOLVE_PAYMENT   LOAN_SOLVE_PAYMENT
+#define SOLVE_PRINCIPLE LOAN_SOLVE_PRINCIPLE
+#define SOLVE_RATE      LOAN_SOLVE_RATE
+#define SOLVE_TERM      LOAN_SOLVE_TERM
+
+#define FORMAT_TEXT    0
+#define FORMAT_COLUMNS 1
+
+// the columns followed by the sensitivities of each row
+#define FORMAT_SENSITIVITY_COLUMNS 2
 
 void usage()
 {
     std::cout << "\n"
               << "Usage: loan -p principle [-i interest_rate | -t loan_period]"
               << "\n       loan -m payment [-i interest_rate | -t loan_period]"
+              << "\n       loan -p principle -m payment"
+              << " [-i interest_rate | -t loan_period]"
+              << "\n       loan -b file"
+              << "\n       loan -P file [-C prepayments]..."
+              << "\n       loan -p principle -i interest_rate -t loan_period"
+              << " -A arm [-L caps]\n            [-M simulation [-s seed]]"
+              << "\n       loan -p principle -i interest_rate -t loan_period"
+              << " [-E extras]\n            [-X lumps@month]"
+              << "\n       loan -S socket_path"
+              << "\n       loan -c [-g] [-k columns]"
+              << "\n       [-R rates] [-T periods] [-j threads] [-a] [-g]"
+              << " [-k columns]\n       [-f format]"
               << "\nExample: loan -i 7.0 -p 39000.00 -t 60.0\n\n"
               << "-i  simple yearly interest rate\n"
               << "-p  principle amount of loan\n"
               << "-t  loan period in months (ie. number of payments)\n"
               << "-m  monthly payment\n"
+              << "-R  rates to sweep as first:last:step (default 1:25:1)\n"
+              << "-T  periods to sweep as first:last:step (default 12:360:12)\n"
+              << "-j  threads to sweep with (default one per cpu)\n"
+              << "-a  also print the amortization schedule (needs three of"
+              << " -p -m -i -t, or -b)\n"
+              << "-g  also print the first and second derivatives of the"
+              << " payment, or principle,\n    by rate and by period\n"
+              << "-k  columns after the payment or principle: full (default),"
+              << " cost for just\n    the interest and total, or bare for"
+              << " none\n"
+              << "-b  solve each line of file (- for stdin) given as\n"
+              << "    principle,payment,rate,period with the one to solve for"
+              << " empty, or as\n    principle payment rate period with it"
+              << " 0\n"
+              << "-P  add up the monthly cash flows of every loan in file,"
+              << " given as for -b\n"
+              << "-C  with -P, project prepayments at a yearly CPR such as 6,"
+              << " CPRs for\n    successive months such as 2,4,6, or a PSA"
+              << " speed such as 150psa\n"
+              << "-A  adjustable rate terms as fixed:reset:margin:index, the"
+              << " months at -i,\n    months between resets, margin over"
+              << " the index and the index now, or\n    the index at each"
+              << " reset as index,index,... the last holding\n"
+              << "-L  adjustable rate caps as initial:periodic:lifetime[:floor]"
+              << ", 0 for none\n"
+              << "-M  simulate paths:volatility index paths, the index"
+              << " moving with the given\n    yearly volatility in"
+              << " percentage points, and print payment percentiles\n"
+              << "-s  seed of the simulation (default 1)\n"
+              << "-E  extra monthly payments to try as first:last:step\n"
+              << "-X  lump sums to try as first:last:step, paid with payment"
+              << " @month\n"
+              << "-S  answer quotes over a unix socket until interrupted\n"
+              << "-c  answer one line of -p/-m/-i/-t flags per line of stdin\n"
+              << "-f  text (default) or columns, binary columns of little"
+              << " endian doubles\n"
               << "-h  help I don't understand\n\n"
               << "Ordering of arguments does not matter.\n"
               << "Unspecified arguments will be solved if possible.\n"
@@ -49,232 +163,2566 @@ void usage()
               << std::endl;
 }
 
-void help()
+void help()
+{
+    std::cout << "Definitions:\n"
+              << "Break Even Years = number of years to pay off principle if"
+              << " payment went to principle alone.\n"
+              << "Interest% = Total interest paid as a percentage of Principal."
+              << std::endl;
+}
+
+// ----------------------------------------------------------------------------
+
+// discount factors already worked out, keyed on the exact bits of the
+// yearly rate and period. a loan tape only has a few hundred distinct
+// (rate, period) pairs, and since payment and principle are linear in each
+// other only the factor needs remembering. batch mode, the quote server and
+// the co-process all look their payments and principles up here. open
+// addressing in a fixed table that is simply emptied when it gets too full.
+class FactorCache
+{
+public:
+    enum { SLOTS = 1 << 14 };
+
+    FactorCache()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        std::memset(filled, 0, sizeof(filled));
+        used = 0;
+    }
+
+    bool find(double yearlyInterestRate, double numberPayments,
+              double &x) const
+    {
+        uint64_t rate = bits(yearlyInterestRate);
+        uint64_t period = bits(numberPayments);
+
+        for(size_t i = slot(rate, period); filled[i]; i = (i + 1) % SLOTS)
+        {
+            if(rates[i] == rate && periods[i] == period)
+            {
+                x = factors[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void insert(double yearlyInterestRate, double numberPayments, double x)
+    {
+        if(used >= SLOTS / 2)
+        {
+            clear();
+        }
+
+        uint64_t rate = bits(yearlyInterestRate);
+        uint64_t period = bits(numberPayments);
+
+        size_t i = slot(rate, period);
+        while(filled[i] && !(rates[i] == rate && periods[i] == period))
+        {
+            i = (i + 1) % SLOTS;
+        }
+
+        used += !filled[i];
+        filled[i] = true;
+        rates[i] = rate;
+        periods[i] = period;
+        factors[i] = x;
+    }
+
+    // the discount factor, worked out and remembered if it isn't already
+    double factor(double yearlyInterestRate, double numberPayments)
+    {
+        double x;
+        if(!find(yearlyInterestRate, numberPayments, x))
+        {
+            loanDiscountFactors(&yearlyInterestRate, &numberPayments, &x, 1);
+            insert(yearlyInterestRate, numberPayments, x);
+        }
+        return x;
+    }
+
+private:
+    static uint64_t bits(double value)
+    {
+        uint64_t b;
+        std::memcpy(&b, &value, sizeof(b));
+        return b;
+    }
+
+    static size_t slot(uint64_t rate, uint64_t period)
+    {
+        uint64_t h = rate * 0x9E3779B97F4A7C15ULL ^
+                     period * 0xC2B2AE3D27D4EB4FULL;
+        return (h ^ (h >> 29)) % SLOTS;
+    }
+
+    uint64_t rates[SLOTS];
+    uint64_t periods[SLOTS];
+    double factors[SLOTS];
+    bool filled[SLOTS];
+    int used;
+};
+
+// ----------------------------------------------------------------------------
+
+// text output collected in memory and handed to write(2) in large chunks
+// rather than through iostreams. fields are formatted with to_chars() the
+// same way "%-12.2f" would.
+//
+// with FORMAT_COLUMNS, solved rows are written as binary columns instead,
+// laid out like an arrow record batch stream so the columns can be mapped
+// straight into arrays. all numbers are little endian whatever the host,
+// so a file reads the same everywhere, and every block starts on a 64 byte
+// boundary:
+//
+//   header:            "LOANCOL1", u32 column count (8 or 13), u32 value
+//                      size (8), the column names in 16 bytes each, zero
+//                      padded, then zeros up to a multiple of 64
+//   batch:             u64 row count, zeros up to 64, then for each column
+//                      row count f64 values, zero padded to a multiple of 64
+//   end:               a batch with a row count of 0
+//
+// the columns are principle, payment, period, rate, total, interest,
+// interest_pct and breakeven, in that order, and with
+// FORMAT_SENSITIVITY_COLUMNS then d_rate, d_term, d2_rate, d2_rate_term
+// and d2_term.
+class OutputBuffer
+{
+public:
+    enum { FLUSH_SIZE = 1 << 16, BATCH_ROWS = 4096, COLUMN_COUNT = 13 };
+
+    // fd < 0 just collects the output for text() or append()
+    explicit OutputBuffer(int fd = -1, int format = FORMAT_TEXT)
+        : fd(fd), format(format), written(0),
+          columnCount(format == FORMAT_SENSITIVITY_COLUMNS ? 13 : 8)
+    {
+        if(fd >= 0)
+        {
+            std::cout.flush();
+            buffer.reserve(FLUSH_SIZE + 1024);
+        }
+
+        if(fd >= 0 && columns())
+        {
+            static const char names[COLUMN_COUNT][16] = {
+                "principle", "payment", "period", "rate", "total",
+                "interest", "interest_pct", "breakeven", "d_rate", "d_term",
+                "d2_rate", "d2_rate_term", "d2_term"
+            };
+            uint32_t sizes[2] = { littleEndian((uint32_t)columnCount),
+                                  littleEndian((uint32_t)sizeof(double)) };
+
+            buffer.append("LOANCOL1", 8);
+            buffer.append((const char *)sizes, sizeof(sizes));
+            buffer.append(names[0], columnCount * sizeof(names[0]));
+            pad();
+        }
+    }
+
+    ~OutputBuffer()
+    {
+        if(fd >= 0 && columns())
+        {
+            endBatch();
+            buffer.append(64, '\0');
+        }
+        flush();
+    }
+
+    bool columns() const
+    {
+        return format != FORMAT_TEXT;
+    }
+
+    // add one solved loan as a row of the columns, with its sensitivities s
+    // for FORMAT_SENSITIVITY_COLUMNS
+    void row(const LoanResult &r, const LoanSensitivity *s)
+    {
+        values[0].push_back(r.principleAmount);
+        values[1].push_back(r.monthlyPayment);
+        values[2].push_back(r.numberPayments);
+        values[3].push_back(r.yearlyInterestRate);
+        values[4].push_back(r.totalPaid);
+        values[5].push_back(r.interestPaid);
+        values[6].push_back(r.interestPaidPercent);
+        values[7].push_back(r.breakEvenYears);
+        if(columnCount > 8)
+        {
+            values[8].push_back(s->dRate);
+            values[9].push_back(s->dTerm);
+            values[10].push_back(s->d2Rate);
+            values[11].push_back(s->d2RateTerm);
+            values[12].push_back(s->d2Term);
+        }
+
+        // without an fd the rows wait for text() or append()
+        if(fd >= 0 && values[0].size() == BATCH_ROWS)
+        {
+            endBatch();
+            flush();
+        }
+    }
+
+    // move everything other has collected onto the end of this
+    void append(OutputBuffer &other)
+    {
+        buffer.append(other.buffer);
+        other.buffer.clear();
+
+        size_t rows = other.values[0].size();
+        for(size_t begin = 0; begin < rows; )
+        {
+            size_t n = std::min(rows - begin,
+                                BATCH_ROWS - values[0].size());
+            for(int c = 0; c < columnCount; ++c)
+            {
+                values[c].insert(values[c].end(),
+                                 other.values[c].begin() + begin,
+                                 other.values[c].begin() + begin + n);
+            }
+            begin += n;
+
+            if(fd >= 0 && values[0].size() == BATCH_ROWS)
+            {
+                endBatch();
+                flush();
+            }
+        }
+
+        for(int c = 0; c < columnCount; ++c)
+        {
+            other.values[c].clear();
+        }
+    }
+
+    void append(const char *s, size_t length)
+    {
+        buffer.append(s, length);
+    }
+
+    void append(const char *s)
+    {
+        buffer.append(s);
+    }
+
+    // value in fixed point with precision decimals, left justified in a
+    // field at least 12 wide
+    void field(double value, int precision)
+    {
+        char digits[512];
+        std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits),
+                                               value, std::chars_format::fixed,
+                                               precision);
+        size_t length = r.ptr - digits;
+        buffer.append(digits, length);
+        if(length < 12)
+        {
+            buffer.append(12 - length, ' ');
+        }
+    }
+
+    // cents as dollars and cents, exactly, laid out the same way as field()
+    void cents(int64_t value)
+    {
+        uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : value;
+        char digits[32];
+        char *p = digits;
+        if(value < 0)
+        {
+            *p++ = '-';
+        }
+        p = std::to_chars(p, digits + sizeof(digits), magnitude / 100).ptr;
+        *p++ = '.';
+        *p++ = '0' + magnitude % 100 / 10;
+        *p++ = '0' + magnitude % 10;
+
+        size_t length = p - digits;
+        buffer.append(digits, length);
+        if(length < 12)
+        {
+            buffer.append(12 - length, ' ');
+        }
+    }
+
+    // end the line, writing out what we have once there's enough of it
+    void endLine()
+    {
+        buffer.push_back('\n');
+        endLines();
+    }
+
+    // the same once whole lines have been appended
+    void endLines()
+    {
+        if(fd >= 0 && buffer.size() >= FLUSH_SIZE)
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        const char *p = buffer.data();
+        size_t left = buffer.size();
+        while(fd >= 0 && left > 0)
+        {
+            ssize_t n = write(fd, p, left);
+            if(n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(n <= 0)
+            {
+                break;
+            }
+            p += n;
+            left -= n;
+        }
+        if(fd >= 0)
+        {
+            written += buffer.size();
+            buffer.clear();
+        }
+    }
+
+    std::string &text()
+    {
+        endBatch();
+        return buffer;
+    }
+
+private:
+    // zero pad the output to the next multiple of 64 bytes
+    void pad()
+    {
+        buffer.append((64 - (written + buffer.size()) % 64) % 64, '\0');
+    }
+
+    // write the rows collected so far as one batch of columns
+    void endBatch()
+    {
+        uint64_t rows = values[0].size();
+        if(rows == 0)
+        {
+            return;
+        }
+
+        uint64_t count = littleEndian(rows);
+        buffer.append((const char *)&count, sizeof(count));
+        pad();
+        for(int c = 0; c < columnCount; ++c)
+        {
+            if constexpr(!LITTLE_ENDIAN_HOST)
+            {
+                for(double &value : values[c])
+                {
+                    uint64_t bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    bits = littleEndian(bits);
+                    std::memcpy(&value, &bits, sizeof(value));
+                }
+            }
+            buffer.append((const char *)values[c].data(),
+                          rows * sizeof(double));
+            pad();
+            values[c].clear();
+        }
+    }
+
+    // std::endian is C++20, which the build doesn't ask for
+    static constexpr bool LITTLE_ENDIAN_HOST =
+        __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+    // value in little endian byte order
+    template<class T>
+    static T littleEndian(T value)
+    {
+        if constexpr(LITTLE_ENDIAN_HOST)
+        {
+            return value;
+        }
+        else if constexpr(sizeof(T) == 4)
+        {
+            return __builtin_bswap32(value);
+        }
+        else
+        {
+            return __builtin_bswap64(value);
+        }
+    }
+
+    int fd;
+    int format;
+    uint64_t written;
+    int columnCount;
+    std::string buffer;
+    std::vector<double> values[COLUMN_COUNT];
+};
+
+// print the month by month amortization schedule of a solved loan, billed
+// to the cent with the last payment trued up to whatever balance is left.
+// returns false if the loan, or what is paid over it, is too big to bill in
+// cents.
+bool printSchedule(OutputBuffer &out, const LoanResult &r)
+{
+    LoanCents principleAmount = loanToCents(r.principleAmount);
+    LoanCents monthlyPayment = loanToCents(r.monthlyPayment);
+    if(principleAmount == LOAN_CENTS_INVALID ||
+       monthlyPayment == LOAN_CENTS_INVALID ||
+       loanToCents(r.totalPaid) == LOAN_CENTS_INVALID)
+    {
+        out.flush();
+        std::cerr << "Loan too large to schedule to the cent" << std::endl;
+        return false;
+    }
+
+    LoanSchedule schedule;
+    loanScheduleStart(&schedule, principleAmount, monthlyPayment,
+                      r.yearlyInterestRate,
+                      (long)std::ceil(r.numberPayments - 1e-9));
+
+    LoanScheduleRow rows[256];
+    long count;
+    while((count = loanScheduleNext(&schedule, rows, 256)) > 0)
+    {
+        long month = schedule.month - count;
+        for(long i = 0; i < count; ++i)
+        {
+            out.append("Month: ");
+            out.field(++month, 0);
+            out.append("\tPayment: ");
+            out.cents(rows[i].payment);
+            out.append("\tInterest: ");
+            out.cents(rows[i].interest);
+            out.append("\tPrinciple: ");
+            out.cents(rows[i].principle);
+            out.append("\tBalance: ");
+            out.cents(rows[i].balance);
+            out.endLine();
+        }
+    }
+
+    // what was actually billed, which P * n only approximates
+    out.append("Total: ");
+    out.cents(schedule.totalPaid);
+    out.append("\tInterest: ");
+    out.cents(schedule.interestPaid);
+    out.endLine();
+    out.endLine();
+    return true;
+}
+
+// print a solved loan, led by the figure that was solved for, with the
+// sensitivities s solved along with it for SHOW_SENSITIVITY. returns false
+// if its schedule can't be printed.
+bool printLoan(OutputBuffer &out, const LoanResult &r, int solveFor,
+               int options, const LoanSensitivity *s = NULL)
+{
+    if(out.columns())
+    {
+        out.row(r, s);
+        return true;
+    }
+
+    char row[LOAN_ROW_SIZE];
+    out.append(row, loanFormatSensitiveRows(row, &r, s, 1, solveFor,
+                                            options & SHOW_FORMAT));
+    out.endLines();
+
+    return !(options & SHOW_SCHEDULE) || printSchedule(out, r);
+}
+
+// solved loans are formatted this many at a time
+#define FORMAT_ROWS 16
+
+// print count solved loans without schedules, and sensitivities[i] with
+// rows[i] for SHOW_SENSITIVITY. the library picks the formatter for
+// solveFor and options once per FORMAT_ROWS rows, each of which is
+// compiled for its own columns, so no row tests any options.
+void printLoans(OutputBuffer &out, const LoanResult *rows,
+                const LoanSensitivity *sensitivities, size_t count,
+                int solveFor, int options)
+{
+    if(out.columns())
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            out.row(rows[i], sensitivities ? sensitivities + i : NULL);
+        }
+        return;
+    }
+
+    char text[FORMAT_ROWS * LOAN_ROW_SIZE];
+    for(size_t i = 0; i < count; i += FORMAT_ROWS)
+    {
+        long n = std::min(count - i, (size_t)FORMAT_ROWS);
+        out.append(text, loanFormatSensitiveRows(
+                             text, rows + i,
+                             sensitivities ? sensitivities + i : NULL, n,
+                             solveFor, options & SHOW_FORMAT));
+        out.endLines();
+    }
+}
+
+// print a solved payment
+bool printPayment(OutputBuffer &out, const LoanResult &r, int options,
+                  const LoanSensitivity *s = NULL)
+{
+    return printLoan(out, r, SOLVE_PAYMENT, options, s);
+}
+
+// print a solved principle
+bool printPrinciple(OutputBuffer &out, const LoanResult &r, int options,
+                    const LoanSensitivity *s = NULL)
+{
+    return printLoan(out, r, SOLVE_PRINCIPLE, options, s);
+}
+
+// solve the sensitivities of a loan solved for solveFor into s if options
+// show them. returns s then, NULL if not.
+const LoanSensitivity *solveSensitivity(const LoanResult &r, int solveFor,
+                                        int options, LoanSensitivity &s)
+{
+    if(!(options & SHOW_SENSITIVITY))
+    {
+        return NULL;
+    }
+
+    if(solveFor == SOLVE_PRINCIPLE)
+    {
+        s = loanPrincipleSensitivity(r.monthlyPayment, r.numberPayments,
+                                     r.yearlyInterestRate);
+    }
+    else
+    {
+        s = loanPaymentSensitivity(r.principleAmount, r.yearlyInterestRate,
+                                   r.numberPayments);
+    }
+    return &s;
+}
+
+// calculate monthly payment given interest and period
+bool calcPayment(double principleAmount, double yearlyInterestRate,
+                 double numberPayments, int options,
+                 int format = FORMAT_TEXT)
+{
+    OutputBuffer out(STDOUT_FILENO, format);
+    LoanResult r = loanSolvePayment(principleAmount, yearlyInterestRate,
+                                    numberPayments);
+    LoanSensitivity s;
+    return printPayment(out, r, options,
+                        solveSensitivity(r, SOLVE_PAYMENT, options, s));
+}
+
+// calculate principle given period and interest
+bool calcPrinciple(double monthlyPayment, double numberPayments,
+                   double yearlyInterestRate, int options,
+                   int format = FORMAT_TEXT)
+{
+    OutputBuffer out(STDOUT_FILENO, format);
+    LoanResult r = loanSolvePrinciple(monthlyPayment, numberPayments,
+                                      yearlyInterestRate);
+    LoanSensitivity s;
+    return printPrinciple(out, r, options,
+                          solveSensitivity(r, SOLVE_PRINCIPLE, options, s));
+}
+
+// calculate interest rate given principle, payment and period
+bool calcRate(double principleAmount, double monthlyPayment,
+              double numberPayments, int options, int format = FORMAT_TEXT)
+{
+    OutputBuffer out(STDOUT_FILENO, format);
+    LoanResult r = loanSolveRate(principleAmount, monthlyPayment,
+                                 numberPayments);
+    LoanSensitivity s;
+    return printPayment(out, r, options,
+                        solveSensitivity(r, SOLVE_RATE, options, s));
+}
+
+// calculate number of payments given principle, payment and interest
+bool calcTerm(double principleAmount, double monthlyPayment,
+              double yearlyInterestRate, int options,
+              int format = FORMAT_TEXT)
+{
+    OutputBuffer out(STDOUT_FILENO, format);
+    LoanResult r = loanSolveTerm(principleAmount, monthlyPayment,
+                                 yearlyInterestRate);
+    LoanSensitivity s;
+    return printPayment(out, r, options,
+                        solveSensitivity(r, SOLVE_TERM, options, s));
+}
+
+// print the "Num Payments:" heading of one block of a full grid
+void printGridHeader(OutputBuffer &out, double numberPayments)
+{
+    char heading[LOAN_ROW_SIZE];
+    out.append(heading, loanFormatHeading(heading, numberPayments));
+    out.endLine();
+}
+
+// ----------------------------------------------------------------------------
+
+// first, first + step, ... up to and including last
+struct SweepRange
+{
+    double first;
+    double last;
+    double step;
+
+    long count() const
+    {
+        return (long)std::floor((last - first) / step + 1e-9) + 1;
+    }
+
+    double at(long i) const
+    {
+        return first + i * step;
+    }
+};
+
+// which periods and rates the sweeps cover, how many threads to use,
+// whether to print text or columns and which columns (SHOW_SENSITIVITY and
+// the LOAN_COLUMNS_* set) every row gets
+struct SweepOptions
+{
+    SweepRange terms;
+    SweepRange rates;
+    int threads;
+    int format;
+    int options;
+};
+
+// rows of a sweep are solved and printed in tiles of this many rows
+#define TILE_ROWS 4096
+
+// print rows [begin, end) of a sweep over periods at a fixed rate, with
+// any extra columns in options. the sensitivities SHOW_SENSITIVITY shows
+// are solved along with the rows.
+void sweepTerms(OutputBuffer &out, int solveFor, double amount,
+                double yearlyInterestRate, const SweepRange &terms,
+                long begin, long end, int options = SHOW_DEFAULT)
+{
+    std::vector<LoanResult> rows(end - begin);
+    if(!(options & SHOW_SENSITIVITY))
+    {
+        loanSweepTerms(solveFor, amount, yearlyInterestRate, terms.first,
+                       terms.step, begin, end, rows.data());
+        printLoans(out, rows.data(), NULL, rows.size(), solveFor,
+                   SHOW_PERIOD | options);
+        return;
+    }
+
+    std::vector<LoanSensitivity> sensitivities(end - begin);
+    loanSweepTermSensitivities(solveFor, amount, yearlyInterestRate,
+                               terms.first, terms.step, begin, end,
+                               rows.data(), sensitivities.data());
+    printLoans(out, rows.data(), sensitivities.data(), rows.size(), solveFor,
+               SHOW_PERIOD | options);
+}
+
+// the same over rates at a fixed period
+void sweepRates(OutputBuffer &out, int solveFor, double amount,
+                double numberPayments, const SweepRange &rates,
+                long begin, long end, int options = SHOW_DEFAULT)
+{
+    std::vector<LoanResult> rows(end - begin);
+    if(!(options & SHOW_SENSITIVITY))
+    {
+        loanSweepRates(solveFor, amount, numberPayments, rates.first,
+                       rates.step, begin, end, rows.data());
+        printLoans(out, rows.data(), NULL, rows.size(), solveFor,
+                   SHOW_RATE | options);
+        return;
+    }
+
+    std::vector<LoanSensitivity> sensitivities(end - begin);
+    loanSweepRateSensitivities(solveFor, amount, numberPayments,
+                               rates.first, rates.step, begin, end,
+                               rows.data(), sensitivities.data());
+    printLoans(out, rows.data(), sensitivities.data(), rows.size(), solveFor,
+               SHOW_RATE | options);
+}
+
+// one tile of a sweep: prints its rows to out
+class Tile
+{
+public:
+    virtual ~Tile() {}
+    virtual void print(OutputBuffer &out, long tile) const = 0;
+};
+
+// call work(i) for every i in [0, count) over up to threads threads,
+// started once, the calling thread being one of them. each takes the next i
+// off a shared counter as soon as it is done with the last, until there are
+// none left.
+template<class Work>
+void parallelFor(long count, int threads, Work work)
+{
+    std::atomic<long> next(0);
+    auto worker = [&]()
+    {
+        long i;
+        while((i = next++) < count)
+        {
+            work(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for(int t = 1; t < threads && t < count; ++t)
+    {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for(size_t t = 0; t < pool.size(); ++t)
+    {
+        pool[t].join();
+    }
+}
+
+// print tiles [0, tileCount) to stdout in order. with more than one
+// thread each tile is printed into one of a ring of buffers, a window of
+// tiles ahead of the last one written out, and whichever thread finishes
+// the next tile due writes it and any ready after it.
+void runTiles(const Tile &tile, long tileCount, int threads, int format)
+{
+    OutputBuffer output(STDOUT_FILENO, format);
+
+    if(threads <= 1 || tileCount <= 1)
+    {
+        for(long i = 0; i < tileCount; ++i)
+        {
+            tile.print(output, i);
+        }
+        return;
+    }
+
+    long window = (long)threads * 4;
+    std::vector<OutputBuffer> buffers(window, OutputBuffer(-1, format));
+    std::vector<char> ready(window, 0);
+    long written = 0;
+    std::mutex lock;
+    std::condition_variable room;
+
+    parallelFor(tileCount, threads, [&](long i)
+    {
+        OutputBuffer &buffer = buffers[i % window];
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            room.wait(guard, [&]() { return i < written + window; });
+        }
+
+        tile.print(buffer, i);
+
+        std::lock_guard<std::mutex> guard(lock);
+        ready[i % window] = 1;
+        if(i != written)
+        {
+            return;
+        }
+        while(written < tileCount && ready[written % window])
+        {
+            ready[written % window] = 0;
+            output.append(buffers[written % window]);
+            output.endLines();
+            ++written;
+        }
+        room.notify_all();
+    });
+}
+
+// tiles of a sweep over periods, every row with the extra columns in
+// options
+class TermTile : public Tile
+{
+public:
+    TermTile(int solveFor, double amount, double yearlyInterestRate,
+             const SweepRange &terms, int options = SHOW_DEFAULT)
+        : solveFor(solveFor), amount(amount), rate(yearlyInterestRate),
+          terms(terms), options(options) {}
+
+    long count() const
+    {
+        return (terms.count() + TILE_ROWS - 1) / TILE_ROWS;
+    }
+
+    void print(OutputBuffer &out, long tile) const
+    {
+        long begin = tile * TILE_ROWS;
+        sweepTerms(out, solveFor, amount, rate, terms, begin,
+                   std::min(begin + TILE_ROWS, terms.count()), options);
+    }
+
+private:
+    int solveFor;
+    double amount;
+    double rate;
+    SweepRange terms;
+    int options;
+};
+
+// tiles of a sweep over rates, or of a full grid when terms is given: every
+// period gets a heading and a blank line after its block of rates. the rows
+// of a grid are tiled straight through from one period to the next, so a
+// grid of few rates still makes tiles of TILE_ROWS rows.
+class RateTile : public Tile
+{
+public:
+    RateTile(int solveFor, double amount, double numberPayments,
+             const SweepRange &rates, const SweepRange *terms = NULL,
+             int options = SHOW_DEFAULT)
+        : solveFor(solveFor), amount(amount), period(numberPayments),
+          rates(rates), grid(terms != NULL), options(options)
+    {
+        if(grid)
+        {
+            this->terms = *terms;
+        }
+        rateCount = rates.count();
+        rows = grid ? rateCount * this->terms.count() : rateCount;
+    }
+
+    long count() const
+    {
+        return (rows + TILE_ROWS - 1) / TILE_ROWS;
+    }
+
+    void print(OutputBuffer &out, long tile) const
+    {
+        long end = std::min((tile + 1) * TILE_ROWS, rows);
+        for(long row = tile * TILE_ROWS; row < end; )
+        {
+            long term = row / rateCount;
+            long begin = row - term * rateCount;
+            long last = std::min(rateCount, begin + end - row);
+            double numberPayments = grid ? terms.at(term) : period;
+
+            if(grid && begin == 0 && !out.columns())
+            {
+                printGridHeader(out, numberPayments);
+            }
+
+            sweepRates(out, solveFor, amount, numberPayments, rates, begin,
+                       last, options);
+
+            if(grid && last == rateCount && !out.columns())
+            {
+                out.endLine();
+            }
+            row += last - begin;
+        }
+    }
+
+private:
+    int solveFor;
+    double amount;
+    double period;
+    SweepRange rates;
+    SweepRange terms;
+    bool grid;
+    int options;
+    long rateCount;
+    long rows;
+};
+
+// ----------------------------------------------------------------------------
+
+// calculate monthly payment given interest
+void calcPaymentAndPeriod(double principleAmount, double yearlyInterestRate,
+                          const SweepOptions &sweep)
+{
+    TermTile tiles(SOLVE_PAYMENT, principleAmount, yearlyInterestRate,
+                   sweep.terms, sweep.options);
+    runTiles(tiles, tiles.count(), sweep.threads, sweep.format);
+}
+
+// calculate monthly payment given period
+void calcPaymentAndInterest(double principleAmount, double numberPayments,
+                            const SweepOptions &sweep)
+{
+    RateTile tiles(SOLVE_PAYMENT, principleAmount, numberPayments,
+                   sweep.rates, NULL, sweep.options);
+    runTiles(tiles, tiles.count(), sweep.threads, sweep.format);
+}
+
+// calculate payment, period, and interest
+void calcPaymentPeriodAndInterest(double principleAmount,
+                                  const SweepOptions &sweep)
+{
+    RateTile tiles(SOLVE_PAYMENT, principleAmount, 0, sweep.rates,
+                   &sweep.terms, sweep.options);
+    runTiles(tiles, tiles.count(), sweep.threads, sweep.format);
+}
+
+// ----------------------------------------------------------------------------
+
+// calculate principle and interest given period
+void calcPrincipleAndInterest(double monthlyPayment, double numberPayments,
+                              const SweepOptions &sweep)
+{
+    RateTile tiles(SOLVE_PRINCIPLE, monthlyPayment, numberPayments,
+                   sweep.rates, NULL, sweep.options);
+    runTiles(tiles, tiles.count(), sweep.threads, sweep.format);
+}
+
+// calculate principle and period given interest
+void calcPrincipleAndPeriod(double monthlyPayment, double yearlyInterestRate,
+                            const SweepOptions &sweep)
+{
+    TermTile tiles(SOLVE_PRINCIPLE, monthlyPayment, yearlyInterestRate,
+                   sweep.terms, sweep.options);
+    runTiles(tiles, tiles.count(), sweep.threads, sweep.format);
+}
+
+// calculate principle, period, and interest
+void calcPrinciplePeriodAndInterest(double monthlyPayment,
+                                    const SweepOptions &sweep)
+{
+    RateTile tiles(SOLVE_PRINCIPLE, monthlyPayment, 0, sweep.rates,
+                   &sweep.terms, sweep.options);
+    runTiles(tiles, tiles.count(), sweep.threads, sweep.format);
+}
+
+// ----------------------------------------------------------------------------
+
+// split the batch line [p, end) into principle, payment, rate and period.
+// fields are separated by a comma, a tab or a run of spaces. an empty
+// field, or one of 0, means "solve for it"; between spaces only 0 can say
+// that. returns false if a field is not a number or anything but blanks
+// follows the fourth.
+bool parseBatchLine(const char *p, const char *end, double fields[4])
+{
+    for(int i = 0; i < 4; ++i)
+    {
+        fields[i] = -1;
+    }
+
+    for(int i = 0; i < 4 && p != end; ++i)
+    {
+        while(p != end && *p == ' ')
+        {
+            ++p;
+        }
+
+        if(p != end && *p != ',' && *p != '\t')
+        {
+            // from_chars won't take the leading + that strtod did
+            const char *number = *p == '+' ? p + 1 : p;
+            std::from_chars_result r = std::from_chars(number, end,
+                                                       fields[i]);
+            if(r.ec != std::errc())
+            {
+                return false;
+            }
+            p = r.ptr;
+        }
+
+        const char *field = p;
+        while(p != end && *p == ' ')
+        {
+            ++p;
+        }
+
+        // the fourth field has no separator after it, only blanks
+        if(i < 3 && p != end && (*p == ',' || *p == '\t'))
+        {
+            ++p;
+        }
+        else if(i < 3 && p != end && p == field)
+        {
+            // neither a separator nor spaces after the number
+            return false;
+        }
+    }
+
+    while(p != end && (*p == ' ' || *p == '\t'))
+    {
+        ++p;
+    }
+    return p == end;
+}
+
+// whether [line, end), the first line of a file that isn't a loan, is a
+// column header rather than a bad loan: one without any digits
+bool isHeaderLine(long lineNumber, const char *line, const char *end)
+{
+    return lineNumber == 1 &&
+           std::find_if(line, end, [](char c)
+                        {
+                            return c >= '0' && c <= '9';
+                        }) == end;
+}
+
+// split one line [line, end) of a batch or portfolio file into its four
+// fields. returns false if it holds no loan, with ok saying whether that's
+// because it is blank, a comment or the column header, or false, having
+// said why, because it is bad.
+bool splitLoanLine(long lineNumber, const char *line, const char *end,
+                   double fields[4], bool &ok)
+{
+    ok = true;
+
+    // skip blank lines and comments
+    if(line == end || *line == '#' || *line == '\r')
+    {
+        return false;
+    }
+
+    if(end[-1] == '\r')
+    {
+        --end;
+    }
+
+    if(!parseBatchLine(line, end, fields))
+    {
+        // allow a column header on the first line
+        if(!isHeaderLine(lineNumber, line, end))
+        {
+            std::cerr << "line " << lineNumber << ": not a number"
+                      << std::endl;
+            ok = false;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+// loans read from a batch file waiting to be solved together
+struct BatchBlock
+{
+    enum { SIZE = 1024 };
+
+    double principles[SIZE];
+    double payments[SIZE];
+    double rates[SIZE];
+    double periods[SIZE];
+    double x[SIZE];
+    int solveFor[SIZE];
+    int count;
+
+    // the loans that need their rate solved, gathered together
+    double ratePrinciples[SIZE];
+    double ratePayments[SIZE];
+    double ratePeriods[SIZE];
+    double rateRates[SIZE];
+
+    // the loans whose discount factor isn't in the cache yet
+    double missRates[SIZE];
+    double missPeriods[SIZE];
+    double missFactors[SIZE];
+    int missIndex[SIZE];
+
+    FactorCache cache;
+};
+
+// solve and print every loan in the block, then empty it. returns false if
+// any of their schedules couldn't be printed.
+bool flushBatch(BatchBlock &block, OutputBuffer &out, int options)
+{
+    int rateCount = 0;
+    for(int i = 0; i < block.count; ++i)
+    {
+        if(block.solveFor[i] == SOLVE_RATE)
+        {
+            block.ratePrinciples[rateCount] = block.principles[i];
+            block.ratePayments[rateCount] = block.payments[i];
+            block.ratePeriods[rateCount] = block.periods[i];
+            ++rateCount;
+        }
+    }
+
+    if(rateCount > 0)
+    {
+        loanSolveRates(block.ratePrinciples, block.ratePayments,
+                       block.ratePeriods, block.rateRates, rateCount);
+        rateCount = 0;
+        for(int i = 0; i < block.count; ++i)
+        {
+            if(block.solveFor[i] == SOLVE_RATE)
+            {
+                block.rates[i] = block.rateRates[rateCount++];
+            }
+        }
+    }
+
+    // look up the discount factors we've seen before and compute the rest
+    // in one go. solved rates and periods never use one, and every solved
+    // rate is different, so they would only crowd out the ones that are
+    int missCount = 0;
+    for(int i = 0; i < block.count; ++i)
+    {
+        if((block.solveFor[i] == SOLVE_PAYMENT ||
+            block.solveFor[i] == SOLVE_PRINCIPLE) &&
+           !block.cache.find(block.rates[i], block.periods[i], block.x[i]))
+        {
+            block.missRates[missCount] = block.rates[i];
+            block.missPeriods[missCount] = block.periods[i];
+            block.missIndex[missCount] = i;
+            ++missCount;
+        }
+    }
+
+    loanDiscountFactors(block.missRates, block.missPeriods,
+                        block.missFactors, missCount);
+    for(int j = 0; j < missCount; ++j)
+    {
+        block.x[block.missIndex[j]] = block.missFactors[j];
+        block.cache.insert(block.missRates[j], block.missPeriods[j],
+                           block.missFactors[j]);
+    }
+
+    bool ok = true;
+    for(int i = 0; i < block.count; ++i)
+    {
+        int solveFor = block.solveFor[i];
+        LoanResult r;
+        if(solveFor == SOLVE_PRINCIPLE)
+        {
+            r = loanPrincipleGivenFactor(block.payments[i], block.periods[i],
+                                         block.rates[i], block.x[i]);
+        }
+        else if(solveFor == SOLVE_TERM)
+        {
+            r = loanSolveTerm(block.principles[i], block.payments[i],
+                              block.rates[i]);
+        }
+        else if(solveFor == SOLVE_RATE)
+        {
+            r.principleAmount = block.principles[i];
+            r.monthlyPayment = block.payments[i];
+            r.numberPayments = block.periods[i];
+            r.yearlyInterestRate = block.rates[i];
+            loanTotals(&r);
+        }
+        else
+        {
+            r = loanPaymentGivenFactor(block.principles[i], block.rates[i],
+                                       block.periods[i], block.x[i]);
+        }
+
+        LoanSensitivity s;
+        const LoanSensitivity *sensitivity = solveSensitivity(r, solveFor,
+                                                              options, s);
+        if(solveFor == SOLVE_PRINCIPLE)
+        {
+            ok &= printPrinciple(out, r, options, sensitivity);
+        }
+        else
+        {
+            ok &= printPayment(out, r, options, sensitivity);
+        }
+    }
+
+    block.count = 0;
+    return ok;
+}
+
+// queue one loan, solving the block once it fills up. returns false if
+// that went wrong.
+bool addBatch(BatchBlock &block, OutputBuffer &out, int options,
+              double principleAmount, double monthlyPayment,
+              double yearlyInterestRate, double numberPayments, int solveFor)
+{
+    block.principles[block.count] = principleAmount;
+    block.payments[block.count] = monthlyPayment;
+    block.rates[block.count] = yearlyInterestRate;
+    block.periods[block.count] = numberPayments;
+    block.solveFor[block.count] = solveFor;
+
+    return ++block.count < BatchBlock::SIZE ||
+           flushBatch(block, out, options);
+}
+
+// the one block of loans batch mode solves with, emptied
+BatchBlock &emptyBatchBlock()
+{
+    static BatchBlock block;
+    block.count = 0;
+    return block;
+}
+
+// check one batch line [line, end) and queue its loan. lineNumber counts
+// from 1 and is only used for messages. returns false if the line is bad,
+// or a loan solved to make room for it couldn't be printed.
+bool addBatchLine(BatchBlock &block, OutputBuffer &out, int options,
+                  long lineNumber, const char *line, const char *end)
+{
+    double fields[4];
+    bool ok;
+    if(!splitLoanLine(lineNumber, line, end, fields, ok))
+    {
+        return ok;
+    }
+
+    double principleAmount = fields[0];
+    double monthlyPayment = fields[1];
+    double yearlyInterestRate = fields[2];
+    double numberPayments = fields[3];
+
+    if(principleAmount > 0 && monthlyPayment > 0 &&
+       yearlyInterestRate > 0 && numberPayments <= 0)
+    {
+        if(monthlyPayment <= principleAmount * yearlyInterestRate / 1200.0)
+        {
+            std::cerr << "line " << lineNumber
+                      << ": payment doesn't cover the interest"
+                      << std::endl;
+            return false;
+        }
+        else
+        {
+            return addBatch(block, out, options, principleAmount,
+                            monthlyPayment, yearlyInterestRate,
+                            numberPayments, SOLVE_TERM);
+        }
+    }
+    else if(principleAmount > 0 && monthlyPayment > 0)
+    {
+        if(numberPayments <= 0 || yearlyInterestRate > 0)
+        {
+            std::cerr << "line " << lineNumber
+                      << ": give exactly one of rate and period with"
+                      << " both payment and principle" << std::endl;
+            return false;
+        }
+        else if(monthlyPayment * numberPayments <= principleAmount)
+        {
+            std::cerr << "line " << lineNumber
+                      << ": payments don't cover the principle"
+                      << std::endl;
+            return false;
+        }
+        else
+        {
+            return addBatch(block, out, options, principleAmount,
+                            monthlyPayment, yearlyInterestRate,
+                            numberPayments, SOLVE_RATE);
+        }
+    }
+    else if(yearlyInterestRate <= 0 || numberPayments <= 0)
+    {
+        std::cerr << "line " << lineNumber
+                  << ": both rate and period are required" << std::endl;
+        return false;
+    }
+    else if(monthlyPayment > 0)
+    {
+        return addBatch(block, out, options, principleAmount,
+                        monthlyPayment, yearlyInterestRate, numberPayments,
+                        SOLVE_PRINCIPLE);
+    }
+    else if(principleAmount > 0)
+    {
+        return addBatch(block, out, options, principleAmount,
+                        monthlyPayment, yearlyInterestRate, numberPayments,
+                        SOLVE_PAYMENT);
+    }
+    else
+    {
+        std::cerr << "line " << lineNumber
+                  << ": payment or principle is required" << std::endl;
+        return false;
+    }
+}
+
+// call line(lineNumber, begin, end) for every line of [p, end), newline
+// not included. returns false if any call did.
+template<class Line>
+bool forEachLine(const char *p, const char *end, Line line)
+{
+    bool ok = true;
+    long lineNumber = 0;
+
+    while(p != end)
+    {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if(eol == NULL)
+        {
+            eol = end;
+        }
+
+        ok = line(++lineNumber, p, eol) && ok;
+        p = eol == end ? end : eol + 1;
+    }
+    return ok;
+}
+
+// the same for every line of a stream
+template<class Line>
+bool forEachLine(std::istream &in, Line line)
+{
+    bool ok = true;
+    long lineNumber = 0;
+    std::string text;
+
+    while(std::getline(in, text))
+    {
+        ok = line(++lineNumber, text.data(), text.data() + text.size()) && ok;
+    }
+    return ok;
+}
+
+// the same for every line of a file, or stdin if the file is "-". regular
+// files are mapped and parsed in place; pipes and terminals are read
+// through iostreams.
+template<class Line>
+bool forEachLine(const char *path, Line line)
+{
+    bool useStdin = strcmp(path, "-") == 0;
+    int fd = useStdin ? STDIN_FILENO : open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+
+    // stdin may already be part way through the file
+    struct stat st;
+    off_t start = useStdin ? lseek(fd, 0, SEEK_CUR) : 0;
+    void *data = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && start >= 0 &&
+       st.st_size > start)
+    {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if(data == MAP_FAILED)
+    {
+        if(useStdin)
+        {
+            return forEachLine(std::cin, line);
+        }
+
+        close(fd);
+        std::ifstream in(path);
+        if(!in)
+        {
+            std::cerr << "Cannot open " << path << std::endl;
+            return false;
+        }
+        return forEachLine(in, line);
+    }
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    const char *begin = (const char *)data;
+    bool ok = forEachLine(begin + start, begin + st.st_size, line);
+
+    munmap(data, st.st_size);
+    if(useStdin)
+    {
+        lseek(fd, st.st_size, SEEK_SET);
+    }
+    else
+    {
+        close(fd);
+    }
+    return ok;
+}
+
+// solve one loan per input line: principle,payment,rate,period. lines is
+// one of the forEachLine()s above with its source bound, called with what
+// to do with each line, so the file, the stream and the tape in memory all
+// go through the same driver.
+template<class Lines>
+int runBatch(Lines lines, int options, int format = FORMAT_TEXT)
+{
+    OutputBuffer out(STDOUT_FILENO, format);
+    BatchBlock &block = emptyBatchBlock();
+
+    bool ok = lines([&](long lineNumber, const char *begin, const char *end)
+    {
+        return addBatchLine(block, out, options, lineNumber, begin, end);
+    });
+
+    ok &= flushBatch(block, out, options);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// the same for a file, or stdin if the file is "-"
+int runBatchFile(const char *path, int options, int format = FORMAT_TEXT)
+{
+    return runBatch([&](auto line) { return forEachLine(path, line); },
+                    options, format);
+}
+
+// ----------------------------------------------------------------------------
+
+// a book of loans, one array per figure so the cash flow kernel streams
+// through each of them in order
+struct Portfolio
+{
+    std::vector<double> principles;
+    std::vector<double> payments;
+    std::vector<double> rates;
+    std::vector<double> periods;
+};
+
+// a payment given along with the period may differ from the level payment
+// by this much of it, plus a cent, for rounding
+#define PORTFOLIO_PAYMENT_TOLERANCE 1e-3
+
+// check one portfolio line [line, end) and add its loan. lines are laid out
+// as in a batch file: principle and rate are required along with the
+// period, the payment or both. a missing payment is the level payment and a
+// missing period is solved for; a payment given with the period has to be
+// the level payment for it. returns false if the line is bad.
+bool addPortfolioLine(Portfolio &book, long lineNumber, const char *line,
+                      const char *end)
+{
+    double fields[4];
+    bool ok;
+    if(!splitLoanLine(lineNumber, line, end, fields, ok))
+    {
+        return ok;
+    }
+
+    double principleAmount = fields[0];
+    double monthlyPayment = fields[1];
+    double yearlyInterestRate = fields[2];
+    double numberPayments = fields[3];
+
+    if(principleAmount <= 0 || yearlyInterestRate <= 0)
+    {
+        std::cerr << "line " << lineNumber
+                  << ": both principle and rate are required" << std::endl;
+        return false;
+    }
+    else if(numberPayments <= 0 && monthlyPayment <= 0)
+    {
+        std::cerr << "line " << lineNumber
+                  << ": payment or period is required" << std::endl;
+        return false;
+    }
+    else if(monthlyPayment > 0 &&
+            monthlyPayment <= principleAmount * yearlyInterestRate / 1200.0)
+    {
+        std::cerr << "line " << lineNumber
+                  << ": payment doesn't cover the interest" << std::endl;
+        return false;
+    }
+    else if(numberPayments <= 0)
+    {
+        numberPayments = loanSolveTerm(principleAmount, monthlyPayment,
+                                       yearlyInterestRate).numberPayments;
+    }
+    else if(monthlyPayment > 0)
+    {
+        double level = loanSolvePayment(principleAmount, yearlyInterestRate,
+                                        numberPayments).monthlyPayment;
+        if(!(std::fabs(monthlyPayment - level) <=
+             0.01 + PORTFOLIO_PAYMENT_TOLERANCE * level))
+        {
+            std::cerr << "line " << lineNumber
+                      << ": payment doesn't pay off the loan over the period"
+                      << std::endl;
+            return false;
+        }
+    }
+
+    book.principles.push_back(principleAmount);
+    book.payments.push_back(monthlyPayment);
+    book.rates.push_back(yearlyInterestRate);
+    book.periods.push_back(numberPayments);
+    return true;
+}
+
+// fill in the level payment of every loan that didn't give one
+void solvePortfolioPayments(Portfolio &book)
+{
+    std::vector<long> missing;
+    std::vector<double> rates;
+    std::vector<double> periods;
+    for(size_t i = 0; i < book.payments.size(); ++i)
+    {
+        if(book.payments[i] <= 0)
+        {
+            missing.push_back(i);
+            rates.push_back(book.rates[i]);
+            periods.push_back(book.periods[i]);
+        }
+    }
+
+    std::vector<double> x(missing.size());
+    loanDiscountFactors(rates.data(), periods.data(), x.data(), x.size());
+    for(size_t j = 0; j < missing.size(); ++j)
+    {
+        long i = missing[j];
+        book.payments[i] = loanPaymentGivenFactor(book.principles[i],
+                                                  book.rates[i],
+                                                  book.periods[i],
+                                                  x[j]).monthlyPayment;
+    }
+}
+
+// a prepayment assumption: the conditional prepayment rate, in percent a
+// year, of each month from the first, the last holding for the rest
+struct PrepaymentScenario
+{
+    std::string name;
+    std::vector<double> cprs;
+
+    // the single monthly mortality of months 0 .. months - 1
+    std::vector<double> smm(long months) const
+    {
+        std::vector<double> curve(months);
+        for(long m = 0; m < months; ++m)
+        {
+            curve[m] = loanMonthlyPrepayment(cprs[std::min(m,
+                                                   (long)cprs.size() - 1)]);
+        }
+        return curve;
+    }
+};
+
+// parse a prepayment assumption: one CPR for every month, CPRs for
+// successive months separated by commas, or a percentage of the PSA
+// benchmark such as 150psa. 100psa is 0.2% CPR in the first month rising
+// by 0.2% a month to 6% from the thirtieth on.
+bool parseScenario(const char *arg, PrepaymentScenario &scenario)
+{
+    scenario.name = arg;
+    scenario.cprs.clear();
+
+    char *end = NULL;
+    double value = strtod(arg, &end);
+    if(end != arg && strcmp(end, "psa") == 0)
+    {
+        for(int m = 1; m <= 30; ++m)
+        {
+            scenario.cprs.push_back(value / 100.0 * 0.2 * m);
+        }
+    }
+    else
+    {
+        for(;;)
+        {
+            if(end == arg)
+            {
+                return false;
+            }
+            scenario.cprs.push_back(value);
+            if(*end != ',')
+            {
+                break;
+            }
+            arg = end + 1;
+            value = strtod(arg, &end);
+        }
+        if(*end != '\0')
+        {
+            return false;
+        }
+    }
+
+    for(size_t i = 0; i < scenario.cprs.size(); ++i)
+    {
+        if(!(scenario.cprs[i] >= 0 && scenario.cprs[i] <= 100))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// loans each thread adds up at a time. every chunk gets its own months,
+// which are added together in chunk order afterwards, so the totals don't
+// depend on how many threads there were or which got which chunk
+#define PORTFOLIO_CHUNK 16384
+
+// the month by month interest, principle and prepayments of the whole
+// book, months long, added up over threads. smm is the single monthly
+// mortality of each month, or NULL for no prepayments.
+void portfolioCashFlows(const Portfolio &book, long months, int threads,
+                        const double *smm, std::vector<double> &interest,
+                        std::vector<double> &principle,
+                        std::vector<double> &prepaid)
+{
+    long count = book.principles.size();
+    long chunks = (count + PORTFOLIO_CHUNK - 1) / PORTFOLIO_CHUNK;
+    std::vector<double> chunkInterest(chunks * months);
+    std::vector<double> chunkPrinciple(chunks * months);
+    std::vector<double> chunkPrepaid(chunks * months);
+    parallelFor(chunks, threads, [&](long i)
+    {
+        long begin = i * PORTFOLIO_CHUNK;
+        long n = std::min(count - begin, (long)PORTFOLIO_CHUNK);
+        loanPrepaidCashFlows(book.principles.data() + begin,
+                             book.payments.data() + begin,
+                             book.rates.data() + begin,
+                             book.periods.data() + begin, n, smm,
+                             chunkInterest.data() + i * months,
+                             chunkPrinciple.data() + i * months,
+                             chunkPrepaid.data() + i * months, months);
+    });
+
+    interest.assign(months, 0.0);
+    principle.assign(months, 0.0);
+    prepaid.assign(months, 0.0);
+    for(long i = 0; i < chunks; ++i)
+    {
+        for(long m = 0; m < months; ++m)
+        {
+            interest[m] += chunkInterest[i * months + m];
+            principle[m] += chunkPrinciple[i * months + m];
+            prepaid[m] += chunkPrepaid[i * months + m];
+        }
+    }
+}
+
+// print the month by month cash flows of a book of loans, with a column
+// of prepayments if showPrepaid
+void printCashFlows(OutputBuffer &out, long loans,
+                    const std::vector<double> &interest,
+                    const std::vector<double> &principle,
+                    const std::vector<double> &prepaid, bool showPrepaid)
+{
+    long months = interest.size();
+
+    // the balance after each month is the principle still to be repaid,
+    // added up from the end so the book comes out at exactly nothing
+    std::vector<double> balance(months + 1, 0.0);
+    for(long m = months - 1; m >= 0; --m)
+    {
+        balance[m] = balance[m + 1] + principle[m] + prepaid[m];
+    }
+
+    double totalInterest = 0;
+    double totalPaid = 0;
+    for(long m = 0; m < months; ++m)
+    {
+        totalInterest += interest[m];
+        totalPaid += interest[m] + principle[m] + prepaid[m];
+
+        out.append("Month: ");
+        out.field(m + 1, 0);
+        out.append("\tPayment: ");
+        out.field(interest[m] + principle[m], 2);
+        out.append("\tInterest: ");
+        out.field(interest[m], 2);
+        out.append("\tPrinciple: ");
+        out.field(principle[m], 2);
+        if(showPrepaid)
+        {
+            out.append("\tPrepaid: ");
+            out.field(prepaid[m], 2);
+        }
+        out.append("\tBalance: ");
+        out.field(balance[m + 1], 2);
+        out.endLine();
+    }
+
+    out.append("Loans: ");
+    out.field(loans, 0);
+    out.append("\tTotal: ");
+    out.field(totalPaid, 2);
+    out.append("\tInterest: ");
+    out.field(totalInterest, 2);
+    out.endLine();
+}
+
+// print the month by month cash flows of every loan in a file, or stdin if
+// the file is "-", once as scheduled or once for each prepayment scenario
+int runPortfolio(const char *path, int threads,
+                 const std::vector<PrepaymentScenario> &scenarios)
+{
+    Portfolio book;
+    bool ok = forEachLine(path, [&](long lineNumber, const char *begin,
+                                    const char *end)
+    {
+        return addPortfolioLine(book, lineNumber, begin, end);
+    });
+    if(!ok)
+    {
+        return EXIT_FAILURE;
+    }
+
+    solvePortfolioPayments(book);
+
+    long months = 0;
+    for(size_t i = 0; i < book.periods.size(); ++i)
+    {
+        months = std::max(months,
+                          (long)std::ceil(book.periods[i] - 1e-9));
+    }
+
+    OutputBuffer out(STDOUT_FILENO);
+    std::vector<double> interest;
+    std::vector<double> principle;
+    std::vector<double> prepaid;
+
+    if(scenarios.empty())
+    {
+        portfolioCashFlows(book, months, threads, NULL, interest, principle,
+                           prepaid);
+        printCashFlows(out, book.principles.size(), interest, principle,
+                       prepaid, false);
+        return EXIT_SUCCESS;
+    }
+
+    for(size_t s = 0; s < scenarios.size(); ++s)
+    {
+        std::vector<double> smm = scenarios[s].smm(months);
+        portfolioCashFlows(book, months, threads, smm.data(), interest,
+                           principle, prepaid);
+
+        out.append("CPR: ");
+        out.append(scenarios[s].name.c_str());
+        out.endLine();
+        printCashFlows(out, book.principles.size(), interest, principle,
+                       prepaid, true);
+        out.endLine();
+    }
+    return EXIT_SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+
+// an adjustable rate loan: its terms, the index at each reset, the last
+// holding for the rest, and for a simulation how much the index moves and
+// how many paths to take
+struct ArmOptions
+{
+    LoanArm arm;
+    LoanArmCaps caps;
+    std::vector<double> indexes;
+    double volatility;
+    long paths;
+    uint64_t seed;
+};
+
+// paths each thread simulates at a time
+#define ARM_CHUNK 256
+
+// print the mean and percentiles of values, sorting them
+void printDistribution(OutputBuffer &out, std::vector<double> &values)
+{
+    std::sort(values.begin(), values.end());
+
+    double sum = 0;
+    for(size_t i = 0; i < values.size(); ++i)
+    {
+        sum += values[i];
+    }
+
+    static const int percentiles[] = { 5, 25, 50, 75, 95 };
+    out.append("\tMean: ");
+    out.field(sum / values.size(), 2);
+    for(int i = 0; i < 5; ++i)
+    {
+        size_t at = (size_t)std::floor(percentiles[i] / 100.0 *
+                                       (values.size() - 1) + 0.5);
+        char label[16];
+        int length = snprintf(label, sizeof(label), "\tP%d: ",
+                              percentiles[i]);
+        out.append(label, length);
+        out.field(values[at], 2);
+    }
+    out.endLine();
+}
+
+// simulate paths of an adjustable rate loan and print the distribution of
+// the payment of every period, led by the month it starts, and of the
+// interest paid over the whole loan. paths are simulated over threads into
+// their own slots, so the output doesn't depend on how many there were.
+void calcArmPayments(double principleAmount, double yearlyInterestRate,
+                     double numberPayments, const ArmOptions &options,
+                     int threads)
+{
+    long months = (long)std::ceil(numberPayments - 1e-9);
+    long periods = loanArmPeriods(&options.arm, months);
+    long chunks = (options.paths + ARM_CHUNK - 1) / ARM_CHUNK;
+    std::vector<double> payments(options.paths * periods);
+    std::vector<double> interest(options.paths);
+    parallelFor(chunks, threads, [&](long i)
+    {
+        long begin = i * ARM_CHUNK;
+        long end = std::min(begin + ARM_CHUNK, options.paths);
+        loanArmCappedPaths(&options.arm, &options.caps, principleAmount,
+                           yearlyInterestRate, months, options.indexes[0],
+                           options.volatility, options.seed, begin, end,
+                           payments.data() + begin * periods,
+                           interest.data() + begin);
+    });
+
+    OutputBuffer out(STDOUT_FILENO);
+    std::vector<double> values(options.paths);
+    long month = 1;
+    for(long k = 0; k < periods; ++k)
+    {
+        for(long p = 0; p < options.paths; ++p)
+        {
+            values[p] = payments[p * periods + k];
+        }
+
+        out.append("Month: ");
+        out.field(month, 0);
+        printDistribution(out, values);
+        month += k == 0 ? options.arm.fixedMonths : options.arm.resetMonths;
+    }
+
+    out.append("Interest:          ");
+    printDistribution(out, interest);
+}
+
+// print the schedule of an adjustable rate loan, one line per stretch of
+// level payments led by the month it starts, then what was paid in all
+void calcArmSchedule(double principleAmount, double yearlyInterestRate,
+                     double numberPayments, const ArmOptions &options)
+{
+    long months = (long)std::ceil(numberPayments - 1e-9);
+    std::vector<LoanArmPeriod> periods(loanArmPeriods(&options.arm,
+                                                      months));
+    loanArmCappedSchedule(&options.arm, &options.caps, principleAmount,
+                          yearlyInterestRate, months,
+                          options.indexes.data(), options.indexes.size(),
+                          periods.data());
+
+    OutputBuffer out(STDOUT_FILENO);
+    double totalPaid = 0;
+    double interestPaid = 0;
+    for(size_t k = 0; k < periods.size(); ++k)
+    {
+        const LoanArmPeriod &p = periods[k];
+        totalPaid += p.interest + p.principle;
+        interestPaid += p.interest;
+
+        out.append("Month: ");
+        out.field(p.month + 1, 0);
+        out.append("\tRate: ");
+        out.field(p.rate, 3);
+        out.append("\tPayment: ");
+        out.field(p.payment, 2);
+        out.append("\tInterest: ");
+        out.field(p.interest, 2);
+        out.append("\tPrinciple: ");
+        out.field(p.principle, 2);
+        out.append("\tBalance: ");
+        out.field(p.balance, 2);
+        out.endLine();
+    }
+
+    out.append("Total: ");
+    out.field(totalPaid, 2);
+    out.append("\tInterest: ");
+    out.field(interestPaid, 2);
+    out.endLine();
+}
+
+// parse the -A terms fixed:reset:margin:index[,index...]
+bool parseArm(const char *arg, ArmOptions &options)
+{
+    char *end = NULL;
+    options.arm.fixedMonths = strtol(arg, &end, 10);
+    if(*end != ':')
+    {
+        return false;
+    }
+    options.arm.resetMonths = strtol(end + 1, &end, 10);
+    if(*end != ':')
+    {
+        return false;
+    }
+    options.arm.margin = strtod(end + 1, &end);
+    if(*end != ':')
+    {
+        return false;
+    }
+
+    options.indexes.clear();
+    do
+    {
+        arg = end + 1;
+        options.indexes.push_back(strtod(arg, &end));
+        if(end == arg || options.indexes.back() < 0)
+        {
+            return false;
+        }
+    }
+    while(*end == ',');
+
+    return *end == '\0' && options.arm.fixedMonths > 0 &&
+           options.arm.resetMonths > 0 && options.arm.margin > 0;
+}
+
+// parse the -L limits initial:periodic:lifetime[:floor]
+bool parseArmCaps(const char *arg, LoanArmCaps &caps)
+{
+    char *end = NULL;
+    caps.initialCap = strtod(arg, &end);
+    if(*end != ':')
+    {
+        return false;
+    }
+    caps.periodicCap = strtod(end + 1, &end);
+    if(*end != ':')
+    {
+        return false;
+    }
+    caps.lifetimeCap = strtod(end + 1, &end);
+    if(*end == ':')
+    {
+        caps.floor = strtod(end + 1, &end);
+    }
+
+    return *end == '\0' && caps.initialCap >= 0 && caps.periodicCap >= 0 &&
+           caps.lifetimeCap >= 0 && caps.floor >= 0;
+}
+
+// parse the -M simulation paths:volatility
+bool parseMonteCarlo(const char *arg, ArmOptions &options)
 {
-    std::cout << "Definitions:\n"
-              << "Break Even Years = number of years to pay off principle if"
-              << " payment went to principle alone.\n"
-              << "Interest% = Total interest paid as a percentage of Principal."
-              << std::endl;
+    char *end = NULL;
+    options.paths = strtol(arg, &end, 10);
+    if(*end != ':')
+    {
+        return false;
+    }
+    options.volatility = strtod(end + 1, &end);
+
+    return *end == '\0' && options.paths > 0 && options.volatility >= 0;
 }
 
 // ----------------------------------------------------------------------------
 
-// calculate monthly payment given interest and period
-void calcPayment(double principleAmount, double yearlyInterestRate,
-                 double numberPayments, int options)
+// quote server protocol, over a unix stream socket in native (little
+// endian on x86) byte order. clients may send any number of requests
+// without waiting; responses come back in the same order, each carrying
+// the id of its request.
+//
+//   request,  40 bytes: u32 id, u32 solve for (0 payment, 1 principle,
+//                       2 rate, 3 period), f64 principle, f64 payment,
+//                       f64 yearly rate, f64 period
+//   response, 72 bytes: u32 id, i32 status (0 ok, 1 not solvable),
+//                       f64 principle, f64 payment, f64 period,
+//                       f64 yearly rate, f64 total, f64 interest,
+//                       f64 interest%, f64 breakeven years
+struct QuoteRequest
 {
-    double monthlyInterestRate = yearlyInterestRate / 1200.0;
-    double x = pow(1 + monthlyInterestRate, -numberPayments);
-    double monthlyPayment = principleAmount * monthlyInterestRate / (1 - x);
-
-    double totalPaid = monthlyPayment * numberPayments;
-    double interestPaid = totalPaid - principleAmount;
-    double interestPaidPercent = (interestPaid / principleAmount) * 100.0;
+    uint32_t id;
+    uint32_t solveFor;
+    double principleAmount;
+    double monthlyPayment;
+    double yearlyInterestRate;
+    double numberPayments;
+};
 
-    double breakEvenYears = (principleAmount / monthlyPayment) / 12.0;
+struct QuoteResponse
+{
+    uint32_t id;
+    int32_t status;
+    double principleAmount;
+    double monthlyPayment;
+    double numberPayments;
+    double yearlyInterestRate;
+    double totalPaid;
+    double interestPaid;
+    double interestPaidPercent;
+    double breakEvenYears;
+};
 
-    std::cout << "Monthly: "
-              << std::setw(12) << std::left << std::fixed << std::showpoint
-              << std::setprecision(2)
-              << monthlyPayment;
+static_assert(sizeof(QuoteRequest) == 40, "QuoteRequest must be 40 bytes");
+static_assert(sizeof(QuoteResponse) == 72, "QuoteResponse must be 72 bytes");
 
-    if(options & SHOW_PERIOD)
-    {
-        std::cout << "\tNum Payments: ";
-        std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-                  << std::setprecision(2)
-                  << numberPayments;
-    }
+// solve one request, false if it doesn't describe a solvable loan.
+// payments and principles take their discount factor from cache.
+bool solveQuote(const QuoteRequest &q, LoanResult &r, FactorCache &cache)
+{
+    double p = q.principleAmount;
+    double m = q.monthlyPayment;
+    double i = q.yearlyInterestRate;
+    double n = q.numberPayments;
 
-    if(options & SHOW_RATE)
+    switch(q.solveFor)
     {
-        std::cout << "\tRate: ";
-        std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-                  << std::setprecision(2)
-                  << std::showpoint << std::setprecision(3)
-                  << yearlyInterestRate;
+        case SOLVE_PAYMENT:
+            if(!(p > 0 && i > 0 && n > 0))
+            {
+                return false;
+            }
+            r = loanPaymentGivenFactor(p, i, n, cache.factor(i, n));
+            return true;
+        case SOLVE_PRINCIPLE:
+            if(!(m > 0 && i > 0 && n > 0))
+            {
+                return false;
+            }
+            r = loanPrincipleGivenFactor(m, n, i, cache.factor(i, n));
+            return true;
+        case SOLVE_RATE:
+            if(!(p > 0 && m > 0 && n > 0 && m * n > p))
+            {
+                return false;
+            }
+            r = loanSolveRate(p, m, n);
+            return true;
+        case SOLVE_TERM:
+            if(!(p > 0 && m > 0 && i > 0 && m > p * i / 1200.0))
+            {
+                return false;
+            }
+            r = loanSolveTerm(p, m, i);
+            return true;
     }
+    return false;
+}
 
-    std::cout << "\tInterest: ";
-    std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-              << std::setprecision(2)
-              << interestPaid;
+// one client of the quote server with the bytes it has sent that we
+// haven't answered yet and the answers it hasn't read yet
+struct Connection
+{
+    int fd;
+    std::string in;
+    std::string out;
+};
 
-    std::cout << "\tTotal: ";
-    std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-              << std::setprecision(2)
-              << totalPaid;
+// stop reading from a client that isn't reading its answers
+#define MAX_PENDING_OUTPUT (1 << 22)
 
-    std::cout << "\tInterest%: ";
-    std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-              << std::setprecision(2)
-              << interestPaidPercent;
+// answer every whole request waiting in c.in
+void answerQuotes(Connection &c, FactorCache &cache)
+{
+    size_t used = 0;
+    while(c.in.size() - used >= sizeof(QuoteRequest))
+    {
+        QuoteRequest q;
+        std::memcpy(&q, c.in.data() + used, sizeof(q));
+        used += sizeof(q);
 
-    std::cout << "\tBreakeven: ";
-    std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-              << std::setprecision(2)
-              << breakEvenYears;
+        QuoteResponse a;
+        std::memset(&a, 0, sizeof(a));
+        a.id = q.id;
 
-    std::cout << std::endl;
+        LoanResult r;
+        if(solveQuote(q, r, cache))
+        {
+            a.principleAmount = r.principleAmount;
+            a.monthlyPayment = r.monthlyPayment;
+            a.numberPayments = r.numberPayments;
+            a.yearlyInterestRate = r.yearlyInterestRate;
+            a.totalPaid = r.totalPaid;
+            a.interestPaid = r.interestPaid;
+            a.interestPaidPercent = r.interestPaidPercent;
+            a.breakEvenYears = r.breakEvenYears;
+        }
+        else
+        {
+            a.status = 1;
+        }
+        c.out.append((const char *)&a, sizeof(a));
+    }
+    c.in.erase(0, used);
 }
 
-// calculate monthly payment given interest
-void calcPaymentAndPeriod(double principleAmount, double yearlyInterestRate)
+// write as much of c.out as the socket takes, false if the client is gone
+bool sendAnswers(Connection &c)
 {
-    double numberPayments = 12;
-    while(numberPayments < 361)
+    while(!c.out.empty())
     {
-        calcPayment(principleAmount, yearlyInterestRate, numberPayments,
-                    SHOW_PERIOD);
-        numberPayments += 12.0;
+        ssize_t n = write(c.fd, c.out.data(), c.out.size());
+        if(n < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        c.out.erase(0, n);
     }
+    return true;
 }
 
-// calculate monthly payment given period
-void calcPaymentAndInterest(double principleAmount, double numberPayments)
+// set by SIGINT or SIGTERM to shut the quote server down
+static volatile sig_atomic_t serverStopping = 0;
+
+static void stopServer(int)
 {
-    double interestRate = 1.0;
-    while(interestRate < 26.0)
-    {
-        calcPayment(principleAmount, interestRate, numberPayments,
-                    SHOW_RATE);
-        interestRate += 1.0;
-    }
+    serverStopping = 1;
 }
 
-// calculate payment, period, and interest
-void calcPaymentPeriodAndInterest(double principleAmount)
+// answer quotes on a unix socket at path until interrupted or terminated,
+// then remove the socket. one thread polls every client; all requests that
+// arrive together are answered with one write. a stale socket left at path
+// is replaced, but anything else there is left alone.
+int runServer(const char *path)
 {
-    double numberPayments = 12;
-    while(numberPayments < 361)
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if(strlen(path) >= sizeof(address.sun_path))
+    {
+        std::cerr << "Cannot listen on " << path << ": path longer than "
+                  << sizeof(address.sun_path) - 1 << " bytes" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::memcpy(address.sun_path, path, strlen(path) + 1);
+
+    struct stat st;
+    if(lstat(path, &st) == 0)
+    {
+        if(!S_ISSOCK(st.st_mode))
+        {
+            std::cerr << "Cannot listen on " << path << ": address in use"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+        unlink(path);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0 ||
+       bind(listener, (sockaddr *)&address, sizeof(address)) < 0 ||
+       listen(listener, SOMAXCONN) < 0)
+    {
+        std::cerr << "Cannot listen on " << path << ": " << strerror(errno)
+                  << std::endl;
+        if(listener >= 0)
+        {
+            close(listener);
+        }
+        return EXIT_FAILURE;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // SIGINT and SIGTERM only get through while we wait in ppoll(), so one
+    // can't slip in between checking serverStopping and going to sleep
+    struct sigaction stop;
+    std::memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = stopServer;
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+
+    sigset_t blocked;
+    sigset_t waiting;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigprocmask(SIG_BLOCK, &blocked, &waiting);
+    sigdelset(&waiting, SIGINT);
+    sigdelset(&waiting, SIGTERM);
+
+    static FactorCache cache;
+    std::vector<Connection> connections;
+    std::vector<pollfd> fds;
+    char buffer[1 << 16];
+    int status = EXIT_SUCCESS;
+
+    while(!serverStopping)
     {
-        std::cout << "Num Payments: ";
-        std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-                  << std::setprecision(2)
-                  << std::showpoint << std::setprecision(3)
-                  << numberPayments;
-        calcPaymentAndInterest(principleAmount, numberPayments);
-        numberPayments += 12.0;
+        fds.resize(connections.size() + 1);
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for(size_t i = 0; i < connections.size(); ++i)
+        {
+            Connection &c = connections[i];
+            fds[i + 1].fd = c.fd;
+            fds[i + 1].events = 0;
+            if(c.out.size() < MAX_PENDING_OUTPUT)
+            {
+                fds[i + 1].events |= POLLIN;
+            }
+            if(!c.out.empty())
+            {
+                fds[i + 1].events |= POLLOUT;
+            }
+        }
+
+        if(ppoll(&fds[0], fds.size(), NULL, &waiting) < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "poll: " << strerror(errno) << std::endl;
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        // walk backwards so closing a connection doesn't upset the indexes
+        for(size_t i = connections.size(); i > 0; --i)
+        {
+            Connection &c = connections[i - 1];
+            short events = fds[i].revents;
+            bool open = true;
+
+            if(events & (POLLIN | POLLHUP | POLLERR))
+            {
+                ssize_t n = read(c.fd, buffer, sizeof(buffer));
+                if(n > 0)
+                {
+                    c.in.append(buffer, n);
+                    answerQuotes(c, cache);
+                }
+                else if(n == 0 || (errno != EAGAIN && errno != EINTR))
+                {
+                    open = false;
+                }
+            }
+
+            if(open)
+            {
+                open = sendAnswers(c);
+            }
+
+            if(!open)
+            {
+                close(c.fd);
+                connections.erase(connections.begin() + (i - 1));
+            }
+        }
+
+        if(fds[0].revents & POLLIN)
+        {
+            int fd = accept(listener, NULL, NULL);
+            if(fd >= 0)
+            {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                Connection c;
+                c.fd = fd;
+                connections.push_back(c);
+            }
+        }
+    }
 
-        std::cout << std::endl;
+    for(size_t i = 0; i < connections.size(); ++i)
+    {
+        close(connections[i].fd);
     }
+    close(listener);
+    unlink(path);
+    return status;
 }
 
 // ----------------------------------------------------------------------------
 
-// calculate principle given period and interest
-void calcPrinciple(double monthlyPayment, double numberPayments,
-                   double yearlyInterestRate, int options)
+// parse one co-process query: the -p, -m, -i and -t flags just as on the
+// command line, exactly three of them, eg. "-p 39000 -i 7 -t 60"
+bool parseQuery(const std::string &line, QuoteRequest &q)
 {
-    double monthlyInterestRate = yearlyInterestRate / 1200.0;
-    double x = std::pow(1 + monthlyInterestRate, -numberPayments);
-    double principleAmount =  monthlyPayment * (1 - x) / monthlyInterestRate;
+    q.id = 0;
+    q.principleAmount = -1;
+    q.monthlyPayment = -1;
+    q.yearlyInterestRate = -1;
+    q.numberPayments = -1;
 
-    double totalPaid = monthlyPayment * numberPayments;
-    double interestPaid = totalPaid - principleAmount;
-    double interestPaidPercent = (interestPaid / principleAmount) * 100.0;
+    const char *p = line.c_str();
+    for(;;)
+    {
+        while(*p == ' ' || *p == '\t')
+        {
+            ++p;
+        }
+        if(*p == '\0')
+        {
+            break;
+        }
+        if(p[0] != '-' || p[1] == '\0')
+        {
+            return false;
+        }
 
-    double breakEvenYears = (principleAmount / monthlyPayment) / 12.0;
+        char flag = p[1];
+        char *end = NULL;
+        double value = strtod(p + 2, &end);
+        if(end == p + 2)
+        {
+            return false;
+        }
+        p = end;
 
-    std::cout << "Principle: ";
-    std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-              << std::setprecision(2)
-              << principleAmount;
+        switch(flag)
+        {
+            case 'p':
+                q.principleAmount = value;
+                break;
+            case 'm':
+                q.monthlyPayment = value;
+                break;
+            case 'i':
+                q.yearlyInterestRate = value;
+                break;
+            case 't':
+                q.numberPayments = value;
+                break;
+            default:
+                return false;
+        }
+    }
 
-    if(options & SHOW_PERIOD)
+    if(q.principleAmount <= 0)
     {
-        std::cout << "\tNum Payments: ";
-        std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-                  << std::setprecision(2)
-                  << numberPayments;
+        q.solveFor = SOLVE_PRINCIPLE;
     }
-
-    if(options & SHOW_RATE)
+    else if(q.monthlyPayment <= 0)
+    {
+        q.solveFor = SOLVE_PAYMENT;
+    }
+    else if(q.yearlyInterestRate <= 0)
     {
-        std::cout << "\tRate: ";
-        std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-                  << std::setprecision(2)
-                  << std::showpoint << std::setprecision(3)
-                  << yearlyInterestRate;
+        q.solveFor = SOLVE_RATE;
     }
+    else
+    {
+        q.solveFor = SOLVE_TERM;
+    }
+
+    return (q.principleAmount > 0) + (q.monthlyPayment > 0) +
+           (q.yearlyInterestRate > 0) + (q.numberPayments > 0) == 3;
+}
+
+// answer one query per line of in with exactly one line, the same one the
+// command line would print for those flags along with the -g and -k
+// columns in options, or "error: ..." if it can't. each answer is flushed
+// unless more queries are already waiting.
+int runCoprocess(std::istream &in, int options)
+{
+    std::ios_base::sync_with_stdio(false);
 
-    std::cout << "\tInterest: ";
-    std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-              << std::setprecision(2)
-              << interestPaid;
+    OutputBuffer out(STDOUT_FILENO);
+    std::string line;
+    static FactorCache cache;
 
-    std::cout << "\tTotal: ";
-    std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-              << totalPaid;
+    while(std::getline(in, line))
+    {
+        if(!line.empty() && line[line.size() - 1] == '\r')
+        {
+            line.erase(line.size() - 1);
+        }
 
-    std::cout << "Interest%: ";
-    std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-              << std::setprecision(2)
-              << interestPaidPercent;
+        QuoteRequest q;
+        LoanResult r;
+        LoanSensitivity s;
+        if(!parseQuery(line, q))
+        {
+            out.append("error: give exactly three of -p, -m, -i and -t");
+            out.endLine();
+        }
+        else if(!solveQuote(q, r, cache))
+        {
+            out.append("error: loan can't be solved");
+            out.endLine();
+        }
+        else if(q.solveFor == SOLVE_PRINCIPLE)
+        {
+            printPrinciple(out, r, options,
+                           solveSensitivity(r, q.solveFor, options, s));
+        }
+        else if(q.solveFor == SOLVE_RATE)
+        {
+            printPayment(out, r, SHOW_RATE | options,
+                         solveSensitivity(r, q.solveFor, options, s));
+        }
+        else if(q.solveFor == SOLVE_TERM)
+        {
+            printPayment(out, r, SHOW_PERIOD | options,
+                         solveSensitivity(r, q.solveFor, options, s));
+        }
+        else
+        {
+            printPayment(out, r, options,
+                         solveSensitivity(r, q.solveFor, options, s));
+        }
 
-    std::cout << "\tBreakeven: ";
-    std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-              << std::setprecision(2)
-              << breakEvenYears;
+        if(in.rdbuf()->in_avail() <= 0)
+        {
+            out.flush();
+        }
+    }
 
-    std::cout << std::endl;
+    return EXIT_SUCCESS;
 }
 
-// calculate principle and interest given period
-void calcPrincipleAndInterest(double monthlyPayment, double numberPayments)
+// ----------------------------------------------------------------------------
+
+// parse first[:last[:step]] into range, keeping its defaults for anything
+// left out
+bool parseRange(const char *arg, SweepRange &range)
 {
-    double interestRate = 1.0;
-    while(interestRate < 25.0)
+    char *end = NULL;
+    range.first = strtod(arg, &end);
+    range.last = range.first;
+    if(*end == ':')
     {
-        calcPrinciple(monthlyPayment, numberPayments, interestRate,
-                      SHOW_RATE);
-        interestRate += 1.0;
+        range.last = strtod(end + 1, &end);
+        if(*end == ':')
+        {
+            range.step = strtod(end + 1, &end);
+        }
     }
+
+    return *end == '\0' && range.first > 0 && range.step > 0 &&
+           range.last >= range.first;
 }
 
-// calculate principle and period given interest
-void calcPrincipleAndPeriod(double monthlyPayment, double yearlyInterestRate)
+// ----------------------------------------------------------------------------
+
+// print how much sooner a loan is paid off and how much interest that
+// saves, led by the extra amount paid. base is the loan as it stands.
+void printSavings(OutputBuffer &out, const char *label, double amount,
+                  const LoanResult &base, double months, double interest)
+{
+    double baseMonths = std::ceil(base.numberPayments - 1e-9);
+
+    out.append(label);
+    out.field(amount, 2);
+    out.append("\tPayoff Month: ");
+    out.field(months, 0);
+    out.append("\tMonths Saved: ");
+    out.field(baseMonths - months, 0);
+    out.append("\tInterest: ");
+    out.field(interest, 2);
+    out.append("\tInterest Saved: ");
+    out.field(base.interestPaid - interest, 2);
+    out.endLine();
+}
+
+// print what paying each of extras on top of every monthly payment does
+// to a loan. every extra is a loan with a bigger payment whose period is
+// solved in closed form, all of them in one vectorized call; the loan as it
+// stands goes first so it is solved the same way and no extra saves
+// exactly nothing.
+void calcExtraPayments(double principleAmount, double yearlyInterestRate,
+                       double numberPayments, const SweepRange &extras)
 {
-    double numberPayments = 12;
-    while(numberPayments < 361)
+    double monthlyPayment = loanSolvePayment(principleAmount,
+                                             yearlyInterestRate,
+                                             numberPayments).monthlyPayment;
+    long count = extras.count() + 1;
+    std::vector<double> principles(count, principleAmount);
+    std::vector<double> payments(count, monthlyPayment);
+    std::vector<double> rates(count, yearlyInterestRate);
+    for(long i = 1; i < count; ++i)
+    {
+        payments[i] += extras.at(i - 1);
+    }
+
+    std::vector<LoanResult> results(count);
+    loanSolveTerms(principles.data(), payments.data(), rates.data(),
+                   results.data(), count);
+
+    OutputBuffer out(STDOUT_FILENO);
+    for(long i = 1; i < count; ++i)
     {
-        calcPrinciple(monthlyPayment, numberPayments, yearlyInterestRate,
-                      SHOW_PERIOD);
-        numberPayments += 12.0;
+        printSavings(out, "Extra: ", extras.at(i - 1), results[0],
+                     std::ceil(results[i].numberPayments - 1e-9),
+                     results[i].interestPaid);
     }
 }
 
-// calculate principle, period, and interest
-void calcPrinciplePeriodAndInterest(double monthlyPayment)
+// print what paying each of lumps along with payment month does to a loan.
+// the balance after that payment is found in closed form, and what's left
+// of it after each lump is a loan whose period is solved the same way.
+void calcLumpSums(double principleAmount, double yearlyInterestRate,
+                  double numberPayments, const SweepRange &lumps,
+                  long month)
 {
-    double numberPayments = 12;
-    while(numberPayments < 361)
+    double monthlyPayment = loanSolvePayment(principleAmount,
+                                             yearlyInterestRate,
+                                             numberPayments).monthlyPayment;
+    double monthlyInterestRate = yearlyInterestRate / 1200.0;
+    double growth = std::pow(1 + monthlyInterestRate, month);
+    double balance = principleAmount * growth -
+                     monthlyPayment * (growth - 1) / monthlyInterestRate;
+    double interestSoFar = monthlyPayment * month -
+                           (principleAmount - balance);
+
+    // a lump that clears the balance leaves nothing to solve, so it gets
+    // a stand in loan and is sorted out below
+    long count = lumps.count() + 1;
+    std::vector<double> principles(count, principleAmount);
+    std::vector<double> payments(count, monthlyPayment);
+    std::vector<double> rates(count, yearlyInterestRate);
+    for(long i = 1; i < count; ++i)
+    {
+        if(balance > lumps.at(i - 1))
+        {
+            principles[i] = balance - lumps.at(i - 1);
+        }
+    }
+
+    std::vector<LoanResult> results(count);
+    loanSolveTerms(principles.data(), payments.data(), rates.data(),
+                   results.data(), count);
+
+    OutputBuffer out(STDOUT_FILENO);
+    for(long i = 1; i < count; ++i)
     {
-        std::cout << "Num Payments: ";
-        std::cout << std::setw(12) << std::left << std::fixed << std::showpoint
-                  << std::setprecision(2)
-                  << std::showpoint << std::setprecision(3)
-                  << numberPayments;
-        calcPrincipleAndInterest(monthlyPayment, numberPayments);
-        numberPayments += 12.0;
+        if(balance > lumps.at(i - 1))
+        {
+            printSavings(out, "Lump: ", lumps.at(i - 1), results[0],
+                         month + std::ceil(results[i].numberPayments - 1e-9),
+                         interestSoFar + results[i].interestPaid);
+        }
+        else
+        {
+            printSavings(out, "Lump: ", lumps.at(i - 1), results[0], month,
+                         interestSoFar);
+        }
+    }
+}
 
-        std::cout << std::endl;
+// parse the -X lump sums first:last:step@month
+bool parseLumps(const char *arg, SweepRange &lumps, long &month)
+{
+    const char *at = strchr(arg, '@');
+    if(at == NULL)
+    {
+        return false;
     }
+
+    char *end = NULL;
+    month = strtol(at + 1, &end, 10);
+    return *end == '\0' && month > 0 &&
+           parseRange(std::string(arg, at).c_str(), lumps);
 }
 
 // ----------------------------------------------------------------------------
 
+// loan_bench.cpp includes this file with LOAN_NO_MAIN defined
+#ifndef LOAN_NO_MAIN
 int main(int argc, char *argv[])
 {
     double principleAmount = -1;
     double monthlyPayment = -1;
     double yearlyInterestRate = -1;
     double numberPayments = -1;
+    const char *batchFile = NULL;
+    const char *portfolioFile = NULL;
+    std::vector<PrepaymentScenario> scenarios;
+    bool arm = false;
+    bool coprocess = false;
+    SweepRange extras;
+    extras.first = 0;
+    SweepRange lumps;
+    long lumpMonth = 0;
+    ArmOptions armOptions;
+    memset(&armOptions.arm, 0, sizeof(armOptions.arm));
+    memset(&armOptions.caps, 0, sizeof(armOptions.caps));
+    armOptions.paths = 0;
+    armOptions.seed = 1;
+    int schedule = SHOW_DEFAULT;
     int retval = EXIT_FAILURE;
 
+    SweepOptions sweep;
+    sweep.terms.first = 12.0;
+    sweep.terms.last = 360.0;
+    sweep.terms.step = 12.0;
+    sweep.rates.first = 1.0;
+    sweep.rates.last = 25.0;
+    sweep.rates.step = 1.0;
+    sweep.threads = std::thread::hardware_concurrency();
+    sweep.format = FORMAT_TEXT;
+    sweep.options = SHOW_DEFAULT;
+
     int c;
-    while((c = getopt(argc, argv, "h:i:p:t:m:")) != -1)
+    while((c = getopt(argc, argv,
+                      "h:i:p:t:m:b:P:C:A:L:M:s:E:X:R:T:j:agk:S:cf:")) != -1)
     {
         switch(c)
         {
@@ -293,21 +2741,276 @@ int main(int argc, char *argv[])
             case 'm':
                 monthlyPayment = strtod(optarg, NULL);
                 break;
+            case 'b':
+                batchFile = optarg;
+                break;
+            case 'P':
+                portfolioFile = optarg;
+                break;
+            case 'C':
+                scenarios.push_back(PrepaymentScenario());
+                if(!parseScenario(optarg, scenarios.back()))
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'A':
+                arm = true;
+                if(!parseArm(optarg, armOptions))
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'L':
+                if(!parseArmCaps(optarg, armOptions.caps))
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'M':
+                if(!parseMonteCarlo(optarg, armOptions))
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                armOptions.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'E':
+                extras.step = 1.0;
+                if(!parseRange(optarg, extras))
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'X':
+                lumps.step = 1.0;
+                if(!parseLumps(optarg, lumps, lumpMonth))
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'R':
+                if(!parseRange(optarg, sweep.rates))
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'T':
+                if(!parseRange(optarg, sweep.terms))
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j':
+                sweep.threads = atoi(optarg);
+                break;
+            case 'a':
+                schedule = SHOW_SCHEDULE;
+                break;
+            case 'g':
+                sweep.options |= SHOW_SENSITIVITY;
+                break;
+            case 'k':
+                sweep.options &= ~SHOW_COLUMNS;
+                if(strcmp(optarg, "cost") == 0)
+                {
+                    sweep.options |= LOAN_COLUMNS_COST;
+                }
+                else if(strcmp(optarg, "bare") == 0)
+                {
+                    sweep.options |= LOAN_COLUMNS_BARE;
+                }
+                else if(strcmp(optarg, "full") != 0)
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'S':
+                return runServer(optarg);
+            case 'c':
+                coprocess = true;
+                break;
+            case 'f':
+                if(strcmp(optarg, "columns") == 0)
+                {
+                    sweep.format = FORMAT_COLUMNS;
+                }
+                else if(strcmp(optarg, "text") == 0)
+                {
+                    sweep.format = FORMAT_TEXT;
+                }
+                else
+                {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
             default:
                 usage();
                 break;
         }
     }
 
+    // (-c) answer queries with the -g and -k columns
+    if(coprocess)
+    {
+        return runCoprocess(std::cin, sweep.options);
+    }
+
+    // the columns have no room for a schedule and always hold every figure,
+    // and the sensitivities get five more
+    if((schedule || (sweep.options & SHOW_COLUMNS)) &&
+       sweep.format == FORMAT_COLUMNS)
+    {
+        usage();
+        std::cout << "-a and -k cannot be used with -f columns" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if((sweep.options & SHOW_SENSITIVITY) && sweep.format == FORMAT_COLUMNS)
+    {
+        sweep.format = FORMAT_SENSITIVITY_COLUMNS;
+    }
+
+    // (-P) add up the cash flows of every loan in a file, which are
+    // neither loans for the columns nor one schedule
+    if(portfolioFile != NULL)
+    {
+        if(schedule || sweep.format != FORMAT_TEXT)
+        {
+            usage();
+            std::cout << "-P cannot be used with -a or -f columns"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+        return runPortfolio(portfolioFile, sweep.threads, scenarios);
+    }
+    else if(!scenarios.empty())
+    {
+        usage();
+        std::cout << "-C needs -P" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // (-A) schedule an adjustable rate loan, or (-M) simulate it
+    if(arm || armOptions.paths > 0)
+    {
+        if(!arm || principleAmount <= 0 || yearlyInterestRate <= 0 ||
+           numberPayments <= 0 || monthlyPayment > 0 || schedule ||
+           sweep.format != FORMAT_TEXT)
+        {
+            usage();
+            std::cout << "-A needs -p, -i and -t" << std::endl;
+            return EXIT_FAILURE;
+        }
+        else if(armOptions.paths > 0)
+        {
+            calcArmPayments(principleAmount, yearlyInterestRate,
+                            numberPayments, armOptions, sweep.threads);
+        }
+        else
+        {
+            calcArmSchedule(principleAmount, yearlyInterestRate,
+                            numberPayments, armOptions);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // (-E -X) what paying extra does to a loan
+    if(extras.first > 0 || lumpMonth > 0)
+    {
+        if(principleAmount <= 0 || yearlyInterestRate <= 0 ||
+           numberPayments <= 0 || monthlyPayment > 0 || schedule ||
+           sweep.format != FORMAT_TEXT)
+        {
+            usage();
+            std::cout << "-E and -X need -p, -i and -t" << std::endl;
+            return EXIT_FAILURE;
+        }
+        else if(lumpMonth >= std::ceil(numberPayments - 1e-9))
+        {
+            usage();
+            std::cout << "-X month must be before the last payment"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if(extras.first > 0)
+        {
+            calcExtraPayments(principleAmount, yearlyInterestRate,
+                              numberPayments, extras);
+        }
+        if(lumpMonth > 0)
+        {
+            calcLumpSums(principleAmount, yearlyInterestRate, numberPayments,
+                         lumps, lumpMonth);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // (-b) solve every loan in a file, or stdin if the file is "-"
+    if(batchFile != NULL)
+    {
+        return runBatchFile(batchFile, SHOW_PERIOD | SHOW_RATE | schedule |
+                            sweep.options, sweep.format);
+    }
+
     // invalid, must have at least principle (-p) or monthly payment (-m)
     if(principleAmount < 0 && monthlyPayment < 0)
     {
         usage();
     }
+    else if(schedule && (principleAmount > 0) + (monthlyPayment > 0) +
+                        (yearlyInterestRate > 0) + (numberPayments > 0) != 3)
+    {
+        usage();
+        std::cout << "-a needs exactly three of -p, -m, -i and -t" << std::endl;
+    }
+    // (-p -m -t) solve for interest rate
+    else if(principleAmount > 0 && monthlyPayment > 0 &&
+            numberPayments > 0 && yearlyInterestRate < 0)
+    {
+        if(monthlyPayment * numberPayments <= principleAmount)
+        {
+            std::cout << "Payments don't cover the principle" << std::endl;
+        }
+        else
+        {
+            retval = calcRate(principleAmount, monthlyPayment, numberPayments,
+                              SHOW_RATE | schedule | sweep.options,
+                              sweep.format) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    // (-p -m -i) solve for number of payments
+    else if(principleAmount > 0 && monthlyPayment > 0 &&
+            yearlyInterestRate > 0 && numberPayments < 0)
+    {
+        if(monthlyPayment <= principleAmount * yearlyInterestRate / 1200.0)
+        {
+            std::cout << "Payment doesn't cover the interest" << std::endl;
+        }
+        else
+        {
+            retval = calcTerm(principleAmount, monthlyPayment,
+                              yearlyInterestRate,
+                              SHOW_PERIOD | schedule | sweep.options,
+                              sweep.format) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
     else if(principleAmount > 0 && monthlyPayment > 0)
     {
         usage();
         std::cout << "Cannot specify BOTH -m and -p arguments at the same time"
+                  << " unless solving for rate (-t) or period (-i)"
                   << std::endl;
     }
 
@@ -318,20 +3021,23 @@ int main(int argc, char *argv[])
 
         if(numberPayments > 0 && yearlyInterestRate > 0)
         {
-            calcPrinciple(monthlyPayment, numberPayments, yearlyInterestRate,
-                          SHOW_DEFAULT);
+            retval = calcPrinciple(monthlyPayment, numberPayments,
+                                   yearlyInterestRate,
+                                   schedule | sweep.options, sweep.format) ?
+                     EXIT_SUCCESS : EXIT_FAILURE;
         }
         else if(yearlyInterestRate > 0)
         {
-            calcPrincipleAndPeriod(monthlyPayment, yearlyInterestRate);
+            calcPrincipleAndPeriod(monthlyPayment, yearlyInterestRate,
+                                   sweep);
         }
         else if(numberPayments > 0)
         {
-            calcPrincipleAndInterest(monthlyPayment, numberPayments);
+            calcPrincipleAndInterest(monthlyPayment, numberPayments, sweep);
         }
         else
         {
-            calcPrinciplePeriodAndInterest(monthlyPayment);
+            calcPrinciplePeriodAndInterest(monthlyPayment, sweep);
         }
     }
 
@@ -342,20 +3048,21 @@ int main(int argc, char *argv[])
 
         if(numberPayments > 0 && yearlyInterestRate > 0)
         {
-            calcPayment(principleAmount, yearlyInterestRate, numberPayments,
-                        SHOW_DEFAULT);
+            retval = calcPayment(principleAmount, yearlyInterestRate,
+                                 numberPayments, schedule | sweep.options,
+                                 sweep.format) ? EXIT_SUCCESS : EXIT_FAILURE;
         }
         else if(yearlyInterestRate > 0)
         {
-            calcPaymentAndPeriod(principleAmount, yearlyInterestRate);
+            calcPaymentAndPeriod(principleAmount, yearlyInterestRate, sweep);
         }
         else if(numberPayments > 0)
         {
-            calcPaymentAndInterest(principleAmount, numberPayments);
+            calcPaymentAndInterest(principleAmount, numberPayments, sweep);
         }
         else
         {
-            calcPaymentPeriodAndInterest(principleAmount);
+            calcPaymentPeriodAndInterest(principleAmount, sweep);
         }
     }
     else
@@ -365,6 +3072,7 @@ int main(int argc, char *argv[])
 
     return retval;
 }
+#endif
 
 
 // ----------------------------------------------------------------------------
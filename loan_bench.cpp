@@ -0,0 +1,642 @@
+/*
+   loan_bench
+   Steve Connet
+
+   Microbenchmarks for the loan math and output paths. Prints one JSON
+   object with ns/op, rows/s and bytes/s for each benchmark.
+
+   compile with:
+   g++ -O3 -pthread -o loan_bench loan_bench.cpp libloan.cpp
+
+   loan_bench > baseline.json          save a baseline
+   loan_bench -c baseline.json         compare against it
+   loan_bench -s 1.0                   seconds to spend per benchmark
+*/
+
+#define LOAN_NO_MAIN
+#include "loan.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+// keeps the compiler from throwing away results we never look at
+volatile double sink;
+
+// one benchmark: op() runs the thing being measured once and reports how
+// many rows and output bytes that was
+class Benchmark
+{
+public:
+    Benchmark(const char *name) : name(name) {}
+    virtual ~Benchmark() {}
+    virtual void op(long &rows, long &bytes) = 0;
+
+    const char *name;
+};
+
+struct Result
+{
+    const char *name;
+    double nsPerOp;
+    double rowsPerSec;
+    double bytesPerSec;
+};
+
+// run op() in ever bigger batches until one batch takes at least seconds
+Result measure(Benchmark &bench, double seconds)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    long iterations = 1;
+    for(;;)
+    {
+        long rows = 0;
+        long bytes = 0;
+
+        Clock::time_point start = Clock::now();
+        for(long i = 0; i < iterations; ++i)
+        {
+            bench.op(rows, bytes);
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() -
+                                                       start).count();
+
+        if(elapsed >= seconds || iterations >= (1L << 40))
+        {
+            Result r;
+            r.name = bench.name;
+            r.nsPerOp = elapsed * 1e9 / iterations;
+            r.rowsPerSec = rows / elapsed;
+            r.bytesPerSec = bytes / elapsed;
+            return r;
+        }
+
+        iterations *= elapsed > 0 && seconds / elapsed < 10 ? 2 : 10;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+// payment of one fully specified loan, no output
+class SingleQuoteBench : public Benchmark
+{
+public:
+    SingleQuoteBench() : Benchmark("single_quote"), rate(1.0) {}
+
+    void op(long &rows, long &)
+    {
+        // vary the rate so nothing gets hoisted out of the loop
+        rate = rate < 25.0 ? rate + 0.001 : 1.0;
+        sink = loanSolvePayment(250000.0, rate, 360.0).monthlyPayment;
+        ++rows;
+    }
+
+private:
+    double rate;
+};
+
+// 2500 rates at 0.01% steps for one period, formatted into memory
+class RateSweepBench : public Benchmark
+{
+public:
+    RateSweepBench() : Benchmark("rate_sweep")
+    {
+        rates.first = 0.01;
+        rates.last = 25.0;
+        rates.step = 0.01;
+    }
+
+    void op(long &rows, long &bytes)
+    {
+        out.text().clear();
+        sweepRates(out, SOLVE_PAYMENT, 250000.0, 360.0, rates, 0,
+                   rates.count());
+        rows += rates.count();
+        bytes += out.text().size();
+    }
+
+private:
+    SweepRange rates;
+    OutputBuffer out;
+};
+
+// 360 monthly periods at one rate, formatted into memory
+class TermSweepBench : public Benchmark
+{
+public:
+    TermSweepBench() : Benchmark("term_sweep")
+    {
+        terms.first = 1.0;
+        terms.last = 360.0;
+        terms.step = 1.0;
+    }
+
+    void op(long &rows, long &bytes)
+    {
+        out.text().clear();
+        sweepTerms(out, SOLVE_PAYMENT, 250000.0, 6.5, terms, 0,
+                   terms.count());
+        rows += terms.count();
+        bytes += out.text().size();
+    }
+
+private:
+    SweepRange terms;
+    OutputBuffer out;
+};
+
+// the default 30 x 25 payment grid, formatted into memory
+class GridBench : public Benchmark
+{
+public:
+    GridBench() : Benchmark("full_grid")
+    {
+        terms.first = 12.0;
+        terms.last = 360.0;
+        terms.step = 12.0;
+        rates.first = 1.0;
+        rates.last = 25.0;
+        rates.step = 1.0;
+    }
+
+    void op(long &rows, long &bytes)
+    {
+        RateTile tiles(SOLVE_PAYMENT, 250000.0, 0, rates, &terms);
+        out.text().clear();
+        for(long i = 0; i < tiles.count(); ++i)
+        {
+            tiles.print(out, i);
+        }
+        rows += terms.count() * rates.count();
+        bytes += out.text().size();
+    }
+
+private:
+    SweepRange terms;
+    SweepRange rates;
+    OutputBuffer out;
+};
+
+// first and second derivatives of one payment by rate and period in one
+// dual number pass
+class SensitivityBench : public Benchmark
+{
+public:
+    SensitivityBench() : Benchmark("sensitivity"), rate(1.0) {}
+
+    void op(long &rows, long &)
+    {
+        rate = rate < 25.0 ? rate + 0.001 : 1.0;
+        sink = loanPaymentSensitivity(250000.0, rate, 360.0).d2RateTerm;
+        ++rows;
+    }
+
+private:
+    double rate;
+};
+
+// the same by central differences, bumping rate and period and solving
+// again nine times
+class BumpRepriceBench : public Benchmark
+{
+public:
+    BumpRepriceBench() : Benchmark("bump_reprice"), rate(1.0) {}
+
+    void op(long &rows, long &)
+    {
+        rate = rate < 25.0 ? rate + 0.001 : 1.0;
+        const double h = 1e-3;
+        double p[3][3];
+        for(int i = 0; i < 3; ++i)
+        {
+            for(int j = 0; j < 3; ++j)
+            {
+                p[i][j] = loanSolvePayment(250000.0, rate + (i - 1) * h,
+                                           360.0 + (j - 1) * h)
+                          .monthlyPayment;
+            }
+        }
+        sink = (p[2][2] - p[2][0] - p[0][2] + p[0][0]) / (4 * h * h);
+        ++rows;
+    }
+
+private:
+    double rate;
+};
+
+// formatting alone: the same solved row printed over and over
+class FormatterBench : public Benchmark
+{
+public:
+    FormatterBench() : Benchmark("formatter")
+    {
+        r = loanSolvePayment(250000.0, 6.5, 360.0);
+    }
+
+    void op(long &rows, long &bytes)
+    {
+        out.text().clear();
+        for(int i = 0; i < 1000; ++i)
+        {
+            printPayment(out, r, SHOW_PERIOD | SHOW_RATE);
+        }
+        rows += 1000;
+        bytes += out.text().size();
+    }
+
+private:
+    LoanResult r;
+    OutputBuffer out;
+};
+
+// the same 1000 rows printed the way a sweep prints them, through one
+// formatter compiled for their columns
+class FormatRowsBench : public Benchmark
+{
+public:
+    FormatRowsBench() : Benchmark("format_rows"),
+        rows(1000, loanSolvePayment(250000.0, 6.5, 360.0))
+    {
+    }
+
+    void op(long &count, long &bytes)
+    {
+        out.text().clear();
+        printLoans(out, rows.data(), NULL, rows.size(), SOLVE_PAYMENT,
+                   SHOW_PERIOD | SHOW_RATE);
+        count += rows.size();
+        bytes += out.text().size();
+    }
+
+private:
+    std::vector<LoanResult> rows;
+    OutputBuffer out;
+};
+
+// the schedule of a 30 year loan the way it used to be worked out, in
+// doubles, no output
+class DoubleScheduleBench : public Benchmark
+{
+public:
+    DoubleScheduleBench() : Benchmark("schedule_double")
+    {
+        r = loanSolvePayment(250000.0, 6.5, 360.0);
+    }
+
+    void op(long &rows, long &)
+    {
+        double monthlyInterestRate = r.yearlyInterestRate / 1200.0;
+        double balance = r.principleAmount;
+        double paid = 0;
+
+        for(long month = 1; month <= 360; ++month)
+        {
+            double interest = balance * monthlyInterestRate;
+            double principle = r.monthlyPayment - interest;
+            if(month == 360)
+            {
+                principle = balance;
+            }
+            balance -= principle;
+            paid += interest + principle;
+        }
+        sink = paid;
+        rows += 360;
+    }
+
+private:
+    LoanResult r;
+};
+
+// the same schedule billed to the cent by loanScheduleNext()
+class CentScheduleBench : public Benchmark
+{
+public:
+    CentScheduleBench() : Benchmark("schedule_cents")
+    {
+        payment = loanCentPayment(25000000, 6.5, 360);
+    }
+
+    void op(long &rows, long &)
+    {
+        LoanSchedule schedule;
+        LoanScheduleRow months[360];
+        loanScheduleStart(&schedule, 25000000, payment, 6.5, 360);
+        rows += loanScheduleNext(&schedule, months, 360);
+        sink = schedule.totalPaid;
+    }
+
+private:
+    LoanCents payment;
+};
+
+// monthly cash flows of 10000 loans of up to 30 years added up on one
+// thread, no output
+class PortfolioBench : public Benchmark
+{
+public:
+    PortfolioBench(const char *name = "portfolio") : Benchmark(name)
+    {
+        for(int i = 0; i < 10000; ++i)
+        {
+            book.principles.push_back(10000.0 + i * 37.0);
+            book.payments.push_back(-1);
+            book.rates.push_back(1.0 + (i % 2400) * 0.01);
+            book.periods.push_back(12 * (1 + i % 30));
+        }
+        solvePortfolioPayments(book);
+    }
+
+    void op(long &rows, long &)
+    {
+        portfolioCashFlows(book, 360, 1, smm.empty() ? NULL : smm.data(),
+                           interest, principle, prepaid);
+        sink = interest[0];
+        rows += 10000;
+    }
+
+protected:
+    std::vector<double> smm;
+
+private:
+    Portfolio book;
+    std::vector<double> interest;
+    std::vector<double> principle;
+    std::vector<double> prepaid;
+};
+
+// the same book prepaying at 150% PSA
+class PrepaidPortfolioBench : public PortfolioBench
+{
+public:
+    PrepaidPortfolioBench() : PortfolioBench("portfolio_cpr")
+    {
+        PrepaymentScenario scenario;
+        parseScenario("150psa", scenario);
+        smm = scenario.smm(360);
+    }
+};
+
+// 1000 index paths of a 5/1 adjustable rate 30 year loan, no output
+class ArmPathsBench : public Benchmark
+{
+public:
+    ArmPathsBench() : Benchmark("arm_paths"), seed(0)
+    {
+        memset(&arm, 0, sizeof(arm));
+        arm.fixedMonths = 60;
+        arm.resetMonths = 12;
+        arm.margin = 2.75;
+        payments.resize(1000 * loanArmPeriods(&arm, 360));
+        interest.resize(1000);
+    }
+
+    void op(long &rows, long &)
+    {
+        loanArmPaths(&arm, 300000.0, 5.5, 360, 3.0, 1.0, ++seed, 0, 1000,
+                     payments.data(), interest.data());
+        sink = interest[0];
+        rows += 1000;
+    }
+
+private:
+    LoanArm arm;
+    uint64_t seed;
+    std::vector<double> payments;
+    std::vector<double> interest;
+};
+
+// the schedule of a capped 30 year 5/1 adjustable rate loan, no output
+class ArmScheduleBench : public Benchmark
+{
+public:
+    ArmScheduleBench() : Benchmark("arm_schedule"), index(3.0)
+    {
+        memset(&arm, 0, sizeof(arm));
+        arm.fixedMonths = 60;
+        arm.resetMonths = 12;
+        arm.margin = 2.75;
+        memset(&caps, 0, sizeof(caps));
+        caps.initialCap = 2.0;
+        caps.periodicCap = 2.0;
+        caps.lifetimeCap = 5.0;
+    }
+
+    void op(long &rows, long &)
+    {
+        // vary the index so nothing gets hoisted out of the loop
+        index = index < 8.0 ? index + 0.001 : 3.0;
+        LoanArmPeriod periods[26];
+        loanArmCappedSchedule(&arm, &caps, 300000.0, 5.5, 360, &index, 1,
+                              periods);
+        sink = periods[25].interest;
+        rows += 26;
+    }
+
+private:
+    LoanArm arm;
+    LoanArmCaps caps;
+    double index;
+};
+
+// payoff of one loan with 1000 different extra monthly payments, solved
+// together, no output
+class ExtraSweepBench : public Benchmark
+{
+public:
+    ExtraSweepBench()
+        : Benchmark("extra_sweep"), principles(1000, 300000.0),
+          payments(1000), rates(1000, 6.5), results(1000)
+    {
+        double monthlyPayment = loanSolvePayment(300000.0, 6.5,
+                                                 360.0).monthlyPayment;
+        for(int i = 0; i < 1000; ++i)
+        {
+            payments[i] = monthlyPayment + i + 1.0;
+        }
+    }
+
+    void op(long &rows, long &)
+    {
+        loanSolveTerms(principles.data(), payments.data(), rates.data(),
+                       results.data(), 1000);
+        sink = results[999].interestPaid;
+        rows += 1000;
+    }
+
+private:
+    std::vector<double> principles;
+    std::vector<double> payments;
+    std::vector<double> rates;
+    std::vector<LoanResult> results;
+};
+
+// batch mode from parsing to write(2), with stdout sent to /dev/null
+class BatchBench : public Benchmark
+{
+public:
+    BatchBench(const char *name = "batch") : Benchmark(name)
+    {
+        char line[128];
+        for(int i = 0; i < 10000; ++i)
+        {
+            snprintf(line, sizeof(line), "%.2f,,%.3f,%d\n",
+                     10000.0 + i * 37.0, 1.0 + (i % 2400) * 0.01,
+                     12 * (1 + i % 30));
+            tape += line;
+        }
+    }
+
+    void op(long &rows, long &bytes)
+    {
+        std::istringstream in(tape);
+        runBatch([&](auto line) { return forEachLine(in, line); },
+                 SHOW_PERIOD | SHOW_RATE);
+        rows += 10000;
+        bytes += tape.size();
+    }
+
+protected:
+    std::string tape;
+};
+
+// the same tape parsed in place, the way a mapped file is
+class MappedBatchBench : public BatchBench
+{
+public:
+    MappedBatchBench() : BatchBench("batch_mapped") {}
+
+    void op(long &rows, long &bytes)
+    {
+        const char *p = tape.data();
+        runBatch([&](auto line)
+                 {
+                     return forEachLine(p, p + tape.size(), line);
+                 },
+                 SHOW_PERIOD | SHOW_RATE);
+        rows += 10000;
+        bytes += tape.size();
+    }
+};
+
+// ----------------------------------------------------------------------------
+
+// ns/op of name in a baseline written by an earlier run, or -1
+double baselineNsPerOp(const std::string &baseline, const char *name)
+{
+    std::string key = std::string("\"name\": \"") + name + "\"";
+    size_t at = baseline.find(key);
+    if(at == std::string::npos)
+    {
+        return -1;
+    }
+
+    at = baseline.find("\"ns_per_op\": ", at);
+    if(at == std::string::npos)
+    {
+        return -1;
+    }
+    return strtod(baseline.c_str() + at + 13, NULL);
+}
+
+void benchUsage()
+{
+    std::cerr << "Usage: loan_bench [-s seconds] [-c baseline.json]"
+              << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = 0.25;
+    std::string baseline;
+
+    int c;
+    while((c = getopt(argc, argv, "s:c:")) != -1)
+    {
+        switch(c)
+        {
+            case 's':
+                seconds = strtod(optarg, NULL);
+                break;
+            case 'c':
+            {
+                std::ifstream in(optarg);
+                if(!in)
+                {
+                    std::cerr << "Cannot open " << optarg << std::endl;
+                    return EXIT_FAILURE;
+                }
+                std::getline(in, baseline, '\0');
+                break;
+            }
+            default:
+                benchUsage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    SingleQuoteBench singleQuote;
+    RateSweepBench rateSweep;
+    TermSweepBench termSweep;
+    GridBench fullGrid;
+    FormatterBench formatter;
+    FormatRowsBench formatRows;
+    BatchBench batch;
+    MappedBatchBench mappedBatch;
+    DoubleScheduleBench doubleSchedule;
+    CentScheduleBench centSchedule;
+    PortfolioBench portfolio;
+    PrepaidPortfolioBench prepaidPortfolio;
+    ArmPathsBench armPaths;
+    ArmScheduleBench armSchedule;
+    ExtraSweepBench extraSweep;
+    SensitivityBench sensitivity;
+    BumpRepriceBench bumpReprice;
+    Benchmark *benchmarks[] = { &singleQuote, &rateSweep, &termSweep,
+                                &fullGrid, &formatter, &formatRows, &batch,
+                                &mappedBatch, &doubleSchedule,
+                                &centSchedule, &portfolio,
+                                &prepaidPortfolio, &armPaths,
+                                &armSchedule, &extraSweep, &sensitivity,
+                                &bumpReprice };
+    const int count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+    // batch writes to fd 1, so results go out on a copy of it
+    int results = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    OutputBuffer out(results);
+    out.append("{\n  \"benchmarks\": [\n");
+
+    for(int i = 0; i < count; ++i)
+    {
+        Result r = measure(*benchmarks[i], seconds);
+
+        char line[512];
+        int length = snprintf(line, sizeof(line),
+                              "    {\"name\": \"%s\", \"ns_per_op\": %.3f, "
+                              "\"rows_per_sec\": %.0f, \"bytes_per_sec\": %.0f",
+                              r.name, r.nsPerOp, r.rowsPerSec, r.bytesPerSec);
+        out.append(line, length);
+
+        double before = baseline.empty() ? -1 :
+                        baselineNsPerOp(baseline, r.name);
+        if(before > 0)
+        {
+            length = snprintf(line, sizeof(line),
+                              ", \"baseline_ns_per_op\": %.3f, "
+                              "\"speedup\": %.3f",
+                              before, before / r.nsPerOp);
+            out.append(line, length);
+        }
+
+        out.append(i + 1 < count ? "},\n" : "}\n");
+        out.flush();
+    }
+
+    out.append("  ]\n}\n");
+    return EXIT_SUCCESS;
+}